@@ -38,12 +38,62 @@
  * written agreement between you and SINTEF ICT.
  */
 
-#version 130
+#version 150
 
 in vec3 fsLines;
+in Component
+{
+    flat uint object;
+    flat uint face;
+} fs;
 uniform vec3 col;
+uniform vec3 colSelected;
+uniform int lookup;
+uniform usamplerBuffer ranges;
+uniform usamplerBuffer flags;
+uniform usamplerBuffer objects;
+out vec4 fragColor;
+
+// The last component starting at or before the primitive in a table of ranges
+int findComponent(int start, int count, int primitive)
+{
+    int lo = 0, hi = count - 1;
+    while (lo < hi)
+    {
+        int mid = (lo + hi + 1) / 2;
+        if (int(texelFetch(ranges, start + mid).r) <= primitive)
+            lo = mid;
+        else
+            hi = mid - 1;
+    }
+    return lo;
+}
 
 void main(void)
 {
-    gl_FragColor = vec4(col, 1.0);
+    if (lookup == 0)
+    {
+        fragColor = vec4(col, 1.0);
+        return;
+    }
+
+    // The range block, the flag block and the number of faces and edges of the object. The
+    // range block holds the vertices of the faces and the bounds of the edges, and the flag
+    // block the flags of the faces, edges and points (see ColorLookup).
+    uvec4 tables = texelFetch(objects, int(fs.object));
+    int rangeStart = int(tables.x), nFaces = int(tables.z), nEdges = int(tables.w);
+
+    int flag = int(tables.y);
+    if (lookup == 1)
+        flag += int(fs.face);
+    else if (lookup == 2)
+        flag += nFaces + findComponent(rangeStart + 2 * nFaces, nEdges, gl_PrimitiveID);
+    else
+        flag += nFaces + nEdges + gl_PrimitiveID;
+
+    // Visible is bit 0 and selected is bit 1
+    uint bits = texelFetch(flags, flag).r;
+    if ((bits & 1u) == 0u)
+        discard;
+    fragColor = vec4((bits & 2u) != 0u ? colSelected : col, 1.0);
 }
@@ -38,14 +38,62 @@
  * written agreement between you and SINTEF ICT.
  */
 
-#version 130
+#version 150
 
 in vec3 vertexPosition;
 in vec3 vertexNormal;
-uniform mat4 mvp;
+layout(std140) uniform Camera
+{
+    mat4 mvp;
+    vec2 viewport;
+};
 uniform float p;
+uniform bool compact;
+uniform samplerBuffer quantBoxes;
+uniform usamplerBuffer ranges;
+uniform usamplerBuffer objects;
+uniform usamplerBuffer pages;
+out Component
+{
+    flat uint object;
+    flat uint face;
+} fs;
+
+// The vertices in a page of the vertex arena (VERTEX_PAGE)
+const int vertexPage = 64;
+
+vec3 octDecode(vec2 e)
+{
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    if (n.z < 0.0)
+        n.xy = (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+    return normalize(n);
+}
 
 void main(void)
 {
-    gl_Position = mvp * vec4(vertexPosition + p * vertexNormal, 1.0);
+    // The object owns the page of the vertex, and the face is the one whose vertices include it.
+    // The vertex ID includes the base vertex, so it is the position in the arena.
+    uint object = texelFetch(pages, gl_VertexID / vertexPage).r;
+    uvec4 tables = texelFetch(objects, int(object));
+    int rangeStart = int(tables.x), nFaces = int(tables.z);
+    uint face = 0u;
+    for (int f = 0; f < nFaces; f++)
+    {
+        uint first = texelFetch(ranges, rangeStart + 2 * f).r;
+        uint last = texelFetch(ranges, rangeStart + 2 * f + 1).r;
+        if (uint(gl_VertexID) >= first && uint(gl_VertexID) < last)
+            face = uint(f);
+    }
+
+    vec3 position = vertexPosition, normal = vertexNormal;
+    if (compact)
+    {
+        vec4 box = texelFetch(quantBoxes, int(object));
+        position = box.xyz + box.w * vertexPosition;
+        normal = octDecode(vertexNormal.xy);
+    }
+    fs.object = object;
+    fs.face = face;
+    gl_Position = mvp * vec4(position + p * normal, 1.0);
 }
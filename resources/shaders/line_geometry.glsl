@@ -0,0 +1,93 @@
+/*
+ * Copyright (C) 2014 SINTEF ICT,
+ * Applied Mathematics, Norway.
+ *
+ * Contact information:
+ * E-mail: eivind.fonn@sintef.no
+ * SINTEF ICT, Department of Applied Mathematics,
+ * P.O. Box 4760 Sluppen,
+ * 7045 Trondheim, Norway.
+ *
+ * This file is part of BSGUI.
+ *
+ * BSGUI is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * BSGUI is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public
+ * License along with GoTools. If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In accordance with Section 7(b) of the GNU Affero General Public
+ * License, a covered work must retain the producer line in every data
+ * file that is created or manipulated using GoTools.
+ *
+ * Other Usage
+ * You can be released from the requirements of the license by purchasing
+ * a commercial license. Buying such a license is mandatory as soon as you
+ * develop commercial activities involving the GoTools library without
+ * disclosing the source code of your own applications.
+ *
+ * This file may be used in accordance with the terms contained in a
+ * written agreement between you and SINTEF ICT.
+ */
+
+#version 150
+
+layout(lines) in;
+layout(triangle_strip, max_vertices = 4) out;
+
+layout(std140) uniform Camera
+{
+    mat4 mvp;
+    vec2 viewport;
+};
+uniform float lineWidth;
+in Component
+{
+    flat uint object;
+    flat uint face;
+} gs[];
+out Component
+{
+    flat uint object;
+    flat uint face;
+} fs;
+
+// The core profile has no wide lines, so each line becomes a quad of the given width in pixels
+void main(void)
+{
+    vec4 a = gl_in[0].gl_Position, b = gl_in[1].gl_Position;
+
+    // Clip to the near plane first, where the perspective division breaks down
+    float da = a.z + a.w, db = b.z + b.w;
+    if (da < 0.0 && db < 0.0)
+        return;
+    if (da < 0.0)
+        a = mix(a, b, da / (da - db));
+    else if (db < 0.0)
+        b = mix(a, b, da / (da - db));
+
+    // Half the width across the line, in normalized device coordinates
+    vec2 dir = (b.xy / b.w - a.xy / a.w) * viewport;
+    vec2 across = length(dir) > 0.0 ? normalize(vec2(-dir.y, dir.x)) : vec2(0.0, 1.0);
+    vec2 offset = across * lineWidth / viewport;
+
+    vec4 corners[4] = vec4[4](a, a, b, b);
+    for (int i = 0; i < 4; i++)
+    {
+        float side = (i % 2 == 0) ? -1.0 : 1.0;
+        gl_Position = corners[i] + vec4(side * offset * corners[i].w, 0.0, 0.0);
+        gl_PrimitiveID = gl_PrimitiveIDIn;
+        fs.object = gs[1].object;
+        fs.face = gs[1].face;
+        EmitVertex();
+    }
+    EndPrimitive();
+}
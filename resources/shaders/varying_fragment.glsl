@@ -38,11 +38,12 @@
  * written agreement between you and SINTEF ICT.
  */
 
-#version 130
+#version 150
 
 in vec3 outColor;
+out vec4 fragColor;
 
 void main(void)
 {
-    gl_FragColor = vec4(outColor, 1.0);
+    fragColor = vec4(outColor, 1.0);
 }
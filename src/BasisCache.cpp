@@ -0,0 +1,417 @@
+/*
+ * Copyright (C) 2014 SINTEF ICT,
+ * Applied Mathematics, Norway.
+ *
+ * Contact information:
+ * E-mail: eivind.fonn@sintef.no
+ * SINTEF ICT, Department of Applied Mathematics,
+ * P.O. Box 4760 Sluppen,
+ * 7045 Trondheim, Norway.
+ *
+ * This file is part of BSGUI.
+ *
+ * BSGUI is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * BSGUI is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public
+ * License along with GoTools. If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In accordance with Section 7(b) of the GNU Affero General Public
+ * License, a covered work must retain the producer line in every data
+ * file that is created or manipulated using GoTools.
+ *
+ * Other Usage
+ * You can be released from the requirements of the license by purchasing
+ * a commercial license. Buying such a license is mandatory as soon as you
+ * develop commercial activities involving the GoTools library without
+ * disclosing the source code of your own applications.
+ *
+ * This file may be used in accordance with the terms contained in a
+ * written agreement between you and SINTEF ICT.
+ */
+
+#include <algorithm>
+#include <functional>
+
+#include "BasisCache.h"
+
+
+std::mutex BasisCache::m;
+std::unordered_map<BasisCache::Key, BasisCache::Entry, BasisCache::KeyHash> BasisCache::entries;
+std::list<const BasisCache::Key *> BasisCache::lru;
+size_t BasisCache::_capacity = BASISCACHE_DEFAULT_CAPACITY;
+size_t BasisCache::_size = 0;
+size_t BasisCache::_hits = 0;
+size_t BasisCache::_misses = 0;
+
+
+size_t BasisCache::Table::bytes() const
+{
+    return sizeof(Table) + first.size() * sizeof(int) + (values.size() + derivs.size()) * sizeof(double);
+}
+
+
+bool BasisCache::Key::operator==(const Key &other) const
+{
+    return order == other.order && derivs == other.derivs &&
+        knots == other.knots && params == other.params;
+}
+
+
+size_t BasisCache::KeyHash::operator()(const Key &key) const
+{
+    std::hash<double> hasher;
+
+    size_t hash = key.order * 2 + (key.derivs ? 1 : 0);
+    for (auto k : key.knots)
+        hash ^= hasher(k) + 0x9e3779b9 + (hash << 6) + (hash >> 2);
+    for (auto p : key.params)
+        hash ^= hasher(p) + 0x9e3779b9 + (hash << 6) + (hash >> 2);
+
+    return hash;
+}
+
+
+BasisCache::TablePtr BasisCache::get(const Go::BsplineBasis &basis, const std::vector<double> &params,
+                                     bool derivs)
+{
+    Key key;
+    key.order = basis.order();
+    key.derivs = derivs;
+    key.knots.assign(basis.begin(), basis.end());
+    key.params = params;
+
+    m.lock();
+
+    auto found = entries.find(key);
+    if (found != entries.end())
+    {
+        lru.splice(lru.begin(), lru, found->second.pos);
+        _hits++;
+
+        TablePtr ret = found->second.table;
+        m.unlock();
+        return ret;
+    }
+
+    _misses++;
+    m.unlock();
+
+    // Compute without holding the lock, so that loader threads don't serialize on this
+    TablePtr table(compute(key));
+    size_t bytes = table->bytes() + (key.knots.size() + key.params.size()) * sizeof(double);
+
+    m.lock();
+
+    // Another thread may have computed the same table in the meantime
+    found = entries.find(key);
+    if (found != entries.end())
+    {
+        TablePtr ret = found->second.table;
+        m.unlock();
+        return ret;
+    }
+
+    if (bytes <= _capacity)
+    {
+        evict(_capacity - bytes);
+
+        auto inserted = entries.emplace(std::move(key), Entry { table, bytes, lru.end() });
+        lru.push_front(&inserted.first->first);
+        inserted.first->second.pos = lru.begin();
+        _size += bytes;
+    }
+
+    m.unlock();
+
+    return table;
+}
+
+
+size_t BasisCache::capacity()
+{
+    std::lock_guard<std::mutex> lock(m);
+    return _capacity;
+}
+
+
+void BasisCache::setCapacity(size_t bytes)
+{
+    std::lock_guard<std::mutex> lock(m);
+    _capacity = bytes;
+    evict(_capacity);
+}
+
+
+size_t BasisCache::size()
+{
+    std::lock_guard<std::mutex> lock(m);
+    return _size;
+}
+
+
+void BasisCache::clear()
+{
+    std::lock_guard<std::mutex> lock(m);
+    evict(0);
+}
+
+
+size_t BasisCache::hits()
+{
+    std::lock_guard<std::mutex> lock(m);
+    return _hits;
+}
+
+
+size_t BasisCache::misses()
+{
+    std::lock_guard<std::mutex> lock(m);
+    return _misses;
+}
+
+
+void BasisCache::evict(size_t bytes)
+{
+    while (_size > bytes && !lru.empty())
+    {
+        auto found = entries.find(*lru.back());
+        _size -= found->second.bytes;
+        lru.pop_back();
+        entries.erase(found);
+    }
+}
+
+
+BasisCache::Table *BasisCache::compute(const Key &key)
+{
+    const std::vector<double> &t = key.knots;
+    int order = key.order, p = order - 1;
+    int nCoefs = t.size() - order;
+
+    Table *table = new Table();
+    table->order = order;
+    table->first.resize(key.params.size());
+    table->values.resize(key.params.size() * order);
+    if (key.derivs)
+        table->derivs.resize(key.params.size() * order);
+
+    std::vector<double> N(order), left(order), right(order);
+
+    for (uint q = 0; q < key.params.size(); q++)
+    {
+        double x = key.params[q];
+
+        // Find the knot span t[s] <= x < t[s+1], using the last nonempty span at the right end
+        int s;
+        if (x >= t[nCoefs])
+            s = nCoefs - 1;
+        else if (x <= t[p])
+            s = p;
+        else
+            s = std::upper_bound(t.begin() + p, t.begin() + nCoefs + 1, x) - t.begin() - 1;
+
+        table->first[q] = s - p;
+
+        // Cox-de Boor recursion, stopping one degree early if derivatives are required
+        N[0] = 1.0;
+        for (int j = 1; j <= p; j++)
+        {
+            if (j == p && key.derivs)
+            {
+                // N holds the degree p-1 functions s-p+1, ..., s at this point
+                double *d = &table->derivs[q * order];
+                for (int r = 0; r <= p; r++)
+                {
+                    int i = s - p + r;
+                    double a = r > 0 ? N[r-1] / (t[i+p] - t[i]) : 0.0;
+                    double b = r < p ? N[r] / (t[i+p+1] - t[i+1]) : 0.0;
+                    d[r] = p * (a - b);
+                }
+            }
+
+            left[j] = x - t[s+1-j];
+            right[j] = t[s+j] - x;
+
+            double saved = 0.0;
+            for (int r = 0; r < j; r++)
+            {
+                double temp = N[r] / (right[r+1] + left[j-r]);
+                N[r] = saved + right[r+1] * temp;
+                saved = left[j-r] * temp;
+            }
+            N[j] = saved;
+        }
+
+        std::copy(N.begin(), N.end(), table->values.begin() + q * order);
+        if (key.derivs && p == 0)
+            table->derivs[q] = 0.0;
+    }
+
+    return table;
+}
+
+
+// The evaluation kernels are specialized on the spline order, so that the compiler may unroll the
+// innermost loops, for orders 2 to 5 (degrees 1 to 4). The gain over the generic kernel is small
+// and depends on the order, so this is no reason to add more. An order of zero means that the
+// order is only known at runtime.
+//
+// Only the first three coordinates are shown, so the kernels accumulate those and the weight,
+// which goes last. This bounds the accumulators for any dimension.
+
+template <uint O>
+void curveGrid(const BasisCache::Table &table, const double *coefs, int dim, bool rational,
+               std::vector<double> &points)
+{
+    const uint order = O ? O : table.order;
+    const int kdim = dim + (rational ? 1 : 0), shown = std::min(dim, 3);
+    const uint nPts = table.first.size();
+
+    for (uint q = 0; q < nPts; q++)
+    {
+        double pt[4] = {0.0, 0.0, 0.0, 0.0};
+
+        const double *N = &table.values[q * order];
+        const double *c = coefs + table.first[q] * kdim;
+        for (uint a = 0; a < order; a++, c += kdim)
+        {
+            for (int k = 0; k < shown; k++)
+                pt[k] += N[a] * c[k];
+            if (rational)
+                pt[3] += N[a] * c[dim];
+        }
+
+        double w = rational ? pt[3] : 1.0;
+        for (int k = 0; k < shown; k++)
+            points[3*q+k] = pt[k] / w;
+    }
+}
+
+
+template <uint OU, uint OV>
+void surfaceGrid(const BasisCache::Table &uTable, const BasisCache::Table &vTable,
+                 const double *coefs, int nCoefsU, int dim, bool rational,
+                 std::vector<double> &points, std::vector<double> &du, std::vector<double> &dv)
+{
+    const uint orderU = OU ? OU : uTable.order, orderV = OV ? OV : vTable.order;
+    const int kdim = dim + (rational ? 1 : 0), shown = std::min(dim, 3);
+    const uint nPtsU = uTable.first.size(), nPtsV = vTable.first.size();
+
+    for (uint j = 0; j < nPtsV; j++)
+    {
+        const double *Nv = &vTable.values[j * orderV];
+        const double *dNv = &vTable.derivs[j * orderV];
+
+        for (uint i = 0; i < nPtsU; i++)
+        {
+            const double *Nu = &uTable.values[i * orderU];
+            const double *dNu = &uTable.derivs[i * orderU];
+
+            double pt[4] = {0.0, 0.0, 0.0, 0.0};
+            double pu[4] = {0.0, 0.0, 0.0, 0.0};
+            double pv[4] = {0.0, 0.0, 0.0, 0.0};
+
+            for (uint b = 0; b < orderV; b++)
+            {
+                const double *c = coefs + ((vTable.first[j] + b) * nCoefsU + uTable.first[i]) * kdim;
+                for (uint a = 0; a < orderU; a++, c += kdim)
+                {
+                    double n = Nu[a] * Nv[b], nu = dNu[a] * Nv[b], nv = Nu[a] * dNv[b];
+                    for (int k = 0; k < shown; k++)
+                    {
+                        pt[k] += n * c[k];
+                        pu[k] += nu * c[k];
+                        pv[k] += nv * c[k];
+                    }
+                    if (rational)
+                    {
+                        pt[3] += n * c[dim];
+                        pu[3] += nu * c[dim];
+                        pv[3] += nv * c[dim];
+                    }
+                }
+            }
+
+            uint idx = nPtsU * j + i;
+            if (rational)
+            {
+                // Quotient rule on the homogeneous coordinates
+                double w = pt[3], wu = pu[3], wv = pv[3];
+                for (int k = 0; k < shown; k++)
+                {
+                    double x = pt[k] / w;
+                    points[3*idx+k] = x;
+                    du[3*idx+k] = (pu[k] - wu * x) / w;
+                    dv[3*idx+k] = (pv[k] - wv * x) / w;
+                }
+            }
+            else
+                for (int k = 0; k < shown; k++)
+                {
+                    points[3*idx+k] = pt[k];
+                    du[3*idx+k] = pu[k];
+                    dv[3*idx+k] = pv[k];
+                }
+        }
+    }
+}
+
+
+void BasisCache::gridEvaluator(const Go::SplineCurve *crv, const std::vector<double> &params,
+                               std::vector<double> &points)
+{
+    TablePtr table = get(crv->basis(), params, false);
+
+    bool rational = crv->rational();
+    int dim = crv->dimension();
+    const double *coefs = &*(rational ? crv->rcoefs_begin() : crv->coefs_begin());
+
+    points.assign(3 * params.size(), 0.0);
+
+    switch (table->order)
+    {
+    case 2: curveGrid<2>(*table, coefs, dim, rational, points); break;
+    case 3: curveGrid<3>(*table, coefs, dim, rational, points); break;
+    case 4: curveGrid<4>(*table, coefs, dim, rational, points); break;
+    case 5: curveGrid<5>(*table, coefs, dim, rational, points); break;
+    default: curveGrid<0>(*table, coefs, dim, rational, points);
+    }
+}
+
+
+void BasisCache::gridEvaluator(const Go::SplineSurface *srf,
+                               const std::vector<double> &uParams, const std::vector<double> &vParams,
+                               std::vector<double> &points, std::vector<double> &du,
+                               std::vector<double> &dv)
+{
+    TablePtr uTable = get(srf->basis_u(), uParams, true);
+    TablePtr vTable = get(srf->basis_v(), vParams, true);
+
+    bool rational = srf->rational();
+    int dim = srf->dimension(), nCoefsU = srf->numCoefs_u();
+    const double *coefs = &*(rational ? srf->rcoefs_begin() : srf->coefs_begin());
+
+    uint nPts = uParams.size() * vParams.size();
+    points.assign(3 * nPts, 0.0);
+    du.assign(3 * nPts, 0.0);
+    dv.assign(3 * nPts, 0.0);
+
+    // Mixed orders are rare enough to go through the generic kernel
+    switch (uTable->order == vTable->order ? uTable->order : 0)
+    {
+    case 2: surfaceGrid<2,2>(*uTable, *vTable, coefs, nCoefsU, dim, rational, points, du, dv); break;
+    case 3: surfaceGrid<3,3>(*uTable, *vTable, coefs, nCoefsU, dim, rational, points, du, dv); break;
+    case 4: surfaceGrid<4,4>(*uTable, *vTable, coefs, nCoefsU, dim, rational, points, du, dv); break;
+    case 5: surfaceGrid<5,5>(*uTable, *vTable, coefs, nCoefsU, dim, rational, points, du, dv); break;
+    default: surfaceGrid<0,0>(*uTable, *vTable, coefs, nCoefsU, dim, rational, points, du, dv);
+    }
+}
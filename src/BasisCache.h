@@ -0,0 +1,176 @@
+/*
+ * Copyright (C) 2014 SINTEF ICT,
+ * Applied Mathematics, Norway.
+ *
+ * Contact information:
+ * E-mail: eivind.fonn@sintef.no
+ * SINTEF ICT, Department of Applied Mathematics,
+ * P.O. Box 4760 Sluppen,
+ * 7045 Trondheim, Norway.
+ *
+ * This file is part of BSGUI.
+ *
+ * BSGUI is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * BSGUI is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public
+ * License along with GoTools. If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In accordance with Section 7(b) of the GNU Affero General Public
+ * License, a covered work must retain the producer line in every data
+ * file that is created or manipulated using GoTools.
+ *
+ * Other Usage
+ * You can be released from the requirements of the license by purchasing
+ * a commercial license. Buying such a license is mandatory as soon as you
+ * develop commercial activities involving the GoTools library without
+ * disclosing the source code of your own applications.
+ *
+ * This file may be used in accordance with the terms contained in a
+ * written agreement between you and SINTEF ICT.
+ */
+
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include <GoTools/geometry/BsplineBasis.h>
+#include <GoTools/geometry/SplineCurve.h>
+#include <GoTools/geometry/SplineSurface.h>
+
+#ifndef _BASISCACHE_H_
+#define _BASISCACHE_H_
+
+#define BASISCACHE_DEFAULT_CAPACITY (64 * 1024 * 1024)
+
+typedef unsigned int uint;
+
+//! \brief A process-wide cache of evaluated B-spline basis tables.
+//!
+//! Multipatch models tend to reuse a small number of knot vectors and orders across a large
+//! number of patches. Since the tessellators sample every patch at parameter values derived
+//! from the knots, the values of the nonzero basis functions at those parameters are identical
+//! for many patches. This class computes them once, keyed by (knot vector, order, sample
+//! parameters), and shares them between all tessellators.
+//!
+//! Unlike DisplayObject::m, the mutex BasisCache::m is internal: all public methods lock it
+//! themselves and are safe to call from the loader threads. Tables are immutable once created,
+//! so they can be used without holding the lock.
+//!
+//! The cache is bounded by capacity(), measured in bytes. When it is exceeded, the least
+//! recently used tables are evicted. Evicted tables stay alive as long as someone holds a
+//! reference to them.
+class BasisCache
+{
+public:
+    //! \brief The values (and optionally first derivatives) of the nonzero basis functions at a
+    //! sequence of parameter values.
+    struct Table
+    {
+        uint order; //!< The order of the basis.
+
+        //! For each parameter, the index of the first nonzero basis function.
+        std::vector<int> first;
+
+        //! For each parameter, #order basis function values.
+        std::vector<double> values;
+
+        //! For each parameter, #order basis function derivatives (empty if not requested).
+        std::vector<double> derivs;
+
+        //! Approximate memory used by this table, in bytes.
+        size_t bytes() const;
+    };
+
+    typedef std::shared_ptr<const Table> TablePtr;
+
+    //! \brief Returns the basis table for the given basis and parameters, computing it if
+    //! necessary.
+    //!
+    //! \param basis The B-spline basis to evaluate.
+    //! \param params The parameter values to evaluate at.
+    //! \param derivs Whether first derivatives are required.
+    static TablePtr get(const Go::BsplineBasis &basis, const std::vector<double> &params, bool derivs);
+
+    //! \brief Evaluates a curve at the given parameters. Works like
+    //! Go::SplineCurve::gridEvaluator, except that the output always has three components per
+    //! point.
+    static void gridEvaluator(const Go::SplineCurve *crv, const std::vector<double> &params,
+                              std::vector<double> &points);
+
+    //! \brief Evaluates a surface and its first partial derivatives on a grid. Works like
+    //! Go::SplineSurface::gridEvaluator, except that the output always has three components per
+    //! point. The \a u index runs fastest.
+    static void gridEvaluator(const Go::SplineSurface *srf,
+                              const std::vector<double> &uParams, const std::vector<double> &vParams,
+                              std::vector<double> &points, std::vector<double> &du,
+                              std::vector<double> &dv);
+
+    //! Returns the maximal number of bytes held by the cache.
+    static size_t capacity();
+
+    //! Sets the maximal number of bytes held by the cache, evicting tables if necessary.
+    static void setCapacity(size_t bytes);
+
+    //! Returns the number of bytes currently held by the cache.
+    static size_t size();
+
+    //! Removes all tables from the cache.
+    static void clear();
+
+    //! Returns the number of lookups that were served from the cache.
+    static size_t hits();
+
+    //! Returns the number of lookups that required computing a new table.
+    static size_t misses();
+
+private:
+    struct Key
+    {
+        uint order;
+        bool derivs;
+        std::vector<double> knots, params;
+
+        bool operator==(const Key &other) const;
+    };
+
+    struct KeyHash
+    {
+        size_t operator()(const Key &key) const;
+    };
+
+    struct Entry
+    {
+        TablePtr table;
+        size_t bytes;
+        std::list<const Key *>::iterator pos;
+    };
+
+    //! The mutex protecting the cache. Locked internally by all public methods.
+    static std::mutex m;
+
+    static std::unordered_map<Key, Entry, KeyHash> entries;
+
+    //! Keys in order of use, the most recently used first.
+    static std::list<const Key *> lru;
+
+    static size_t _capacity, _size, _hits, _misses;
+
+    //! Evicts tables until the size is within \a bytes. BasisCache::m should be locked.
+    static void evict(size_t bytes);
+
+    //! Computes a new basis table. Does not touch the cache.
+    static Table *compute(const Key &key);
+};
+
+#endif /* _BASISCACHE_H_ */
@@ -0,0 +1,235 @@
+/*
+ * Copyright (C) 2014 SINTEF ICT,
+ * Applied Mathematics, Norway.
+ *
+ * Contact information:
+ * E-mail: eivind.fonn@sintef.no
+ * SINTEF ICT, Department of Applied Mathematics,
+ * P.O. Box 4760 Sluppen,
+ * 7045 Trondheim, Norway.
+ *
+ * This file is part of BSGUI.
+ *
+ * BSGUI is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * BSGUI is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public
+ * License along with GoTools. If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In accordance with Section 7(b) of the GNU Affero General Public
+ * License, a covered work must retain the producer line in every data
+ * file that is created or manipulated using GoTools.
+ *
+ * Other Usage
+ * You can be released from the requirements of the license by purchasing
+ * a commercial license. Buying such a license is mandatory as soon as you
+ * develop commercial activities involving the GoTools library without
+ * disclosing the source code of your own applications.
+ *
+ * This file may be used in accordance with the terms contained in a
+ * written agreement between you and SINTEF ICT.
+ */
+
+#include <algorithm>
+#include <cmath>
+
+#include "BoundingTree.h"
+
+
+//! Half the surface area of a box, the cost measure used for insertion.
+inline float area(const QVector3D &lo, const QVector3D &hi)
+{
+    QVector3D d = hi - lo;
+    return d.x() * d.y() + d.y() * d.z() + d.z() * d.x();
+}
+
+
+BoundingTree::BoundingTree()
+    : root(BOUNDINGTREE_NULL)
+    , freeNodes(BOUNDINGTREE_NULL)
+    , _size(0)
+{
+}
+
+
+uint BoundingTree::insert(const QVector3D &center, float radius, uint data)
+{
+    uint leaf = allocateNode();
+    Node &node = nodes[leaf];
+    node.center = center;
+    node.radius = radius;
+    node.lo = center - QVector3D(radius, radius, radius);
+    node.hi = center + QVector3D(radius, radius, radius);
+    node.maxRadius = radius;
+    node.left = node.right = BOUNDINGTREE_NULL;
+    node.data = data;
+
+    insertLeaf(leaf);
+    _size++;
+    return leaf;
+}
+
+
+void BoundingTree::remove(uint leaf)
+{
+    removeLeaf(leaf);
+    freeNode(leaf);
+    _size--;
+}
+
+
+void BoundingTree::update(uint leaf, const QVector3D &center, float radius)
+{
+    removeLeaf(leaf);
+
+    Node &node = nodes[leaf];
+    node.center = center;
+    node.radius = radius;
+    node.maxRadius = radius;
+    node.lo = center - QVector3D(radius, radius, radius);
+    node.hi = center + QVector3D(radius, radius, radius);
+
+    insertLeaf(leaf);
+}
+
+
+void BoundingTree::clear()
+{
+    nodes.clear();
+    root = freeNodes = BOUNDINGTREE_NULL;
+    _size = 0;
+}
+
+
+bool BoundingTree::bounds(QVector3D *lo, QVector3D *hi) const
+{
+    if (root == BOUNDINGTREE_NULL)
+        return false;
+
+    *lo = nodes[root].lo;
+    *hi = nodes[root].hi;
+    return true;
+}
+
+
+uint BoundingTree::allocateNode()
+{
+    if (freeNodes == BOUNDINGTREE_NULL)
+    {
+        nodes.push_back(Node());
+        return nodes.size() - 1;
+    }
+
+    uint node = freeNodes;
+    freeNodes = nodes[node].parent;
+    return node;
+}
+
+
+void BoundingTree::freeNode(uint node)
+{
+    nodes[node].parent = freeNodes;
+    freeNodes = node;
+}
+
+
+void BoundingTree::insertLeaf(uint leaf)
+{
+    if (root == BOUNDINGTREE_NULL)
+    {
+        root = leaf;
+        nodes[leaf].parent = BOUNDINGTREE_NULL;
+        return;
+    }
+
+    QVector3D lo = nodes[leaf].lo, hi = nodes[leaf].hi;
+
+    // Descend towards the child where the leaf adds the least area, stopping when making a new
+    // parent here is cheaper
+    uint index = root;
+    while (nodes[index].left != BOUNDINGTREE_NULL)
+    {
+        const Node &node = nodes[index];
+        float combined = area(minimum(node.lo, lo), maximum(node.hi, hi));
+        float cost = 2 * combined;
+        float inherited = 2 * (combined - area(node.lo, node.hi));
+
+        float childCost[2];
+        uint children[2] = { node.left, node.right };
+        for (int i = 0; i < 2; i++)
+        {
+            const Node &child = nodes[children[i]];
+            childCost[i] = area(minimum(child.lo, lo), maximum(child.hi, hi)) + inherited;
+            if (child.left != BOUNDINGTREE_NULL)
+                childCost[i] -= area(child.lo, child.hi);
+        }
+
+        if (cost < childCost[0] && cost < childCost[1])
+            break;
+        index = childCost[0] < childCost[1] ? children[0] : children[1];
+    }
+
+    uint sibling = index, oldParent = nodes[sibling].parent;
+    uint parent = allocateNode();
+    nodes[parent].parent = oldParent;
+    nodes[parent].left = sibling;
+    nodes[parent].right = leaf;
+    nodes[sibling].parent = parent;
+    nodes[leaf].parent = parent;
+
+    if (oldParent == BOUNDINGTREE_NULL)
+        root = parent;
+    else if (nodes[oldParent].left == sibling)
+        nodes[oldParent].left = parent;
+    else
+        nodes[oldParent].right = parent;
+
+    refit(parent);
+}
+
+
+void BoundingTree::removeLeaf(uint leaf)
+{
+    if (leaf == root)
+    {
+        root = BOUNDINGTREE_NULL;
+        return;
+    }
+
+    uint parent = nodes[leaf].parent, grandParent = nodes[parent].parent;
+    uint sibling = nodes[parent].left == leaf ? nodes[parent].right : nodes[parent].left;
+
+    nodes[sibling].parent = grandParent;
+    if (grandParent == BOUNDINGTREE_NULL)
+        root = sibling;
+    else
+    {
+        if (nodes[grandParent].left == parent)
+            nodes[grandParent].left = sibling;
+        else
+            nodes[grandParent].right = sibling;
+        refit(grandParent);
+    }
+
+    freeNode(parent);
+}
+
+
+void BoundingTree::refit(uint node)
+{
+    for (; node != BOUNDINGTREE_NULL; node = nodes[node].parent)
+    {
+        Node &n = nodes[node];
+        n.lo = minimum(nodes[n.left].lo, nodes[n.right].lo);
+        n.hi = maximum(nodes[n.left].hi, nodes[n.right].hi);
+        n.maxRadius = std::max(nodes[n.left].maxRadius, nodes[n.right].maxRadius);
+    }
+}
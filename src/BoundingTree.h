@@ -0,0 +1,341 @@
+/*
+ * Copyright (C) 2014 SINTEF ICT,
+ * Applied Mathematics, Norway.
+ *
+ * Contact information:
+ * E-mail: eivind.fonn@sintef.no
+ * SINTEF ICT, Department of Applied Mathematics,
+ * P.O. Box 4760 Sluppen,
+ * 7045 Trondheim, Norway.
+ *
+ * This file is part of BSGUI.
+ *
+ * BSGUI is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * BSGUI is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public
+ * License along with GoTools. If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In accordance with Section 7(b) of the GNU Affero General Public
+ * License, a covered work must retain the producer line in every data
+ * file that is created or manipulated using GoTools.
+ *
+ * Other Usage
+ * You can be released from the requirements of the license by purchasing
+ * a commercial license. Buying such a license is mandatory as soon as you
+ * develop commercial activities involving the GoTools library without
+ * disclosing the source code of your own applications.
+ *
+ * This file may be used in accordance with the terms contained in a
+ * written agreement between you and SINTEF ICT.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include <QVector3D>
+
+#include "Frustum.h"
+
+#ifndef _BOUNDINGTREE_H_
+#define _BOUNDINGTREE_H_
+
+//! The null node of a BoundingTree.
+#define BOUNDINGTREE_NULL 0xFFFFFFFF
+
+typedef unsigned int uint;
+
+//! \brief A dynamic bounding volume hierarchy over spheres.
+//!
+//! Each leaf holds a bounding sphere and a user value, and each internal node holds the
+//! axis-aligned box around its two children, along with the largest leaf radius below it. Leaves
+//! can be inserted, removed and moved at any time. A new leaf is placed next to the sibling where
+//! it increases the total surface area of the boxes the least, so queries visit a number of nodes
+//! roughly logarithmic in the number of leaves outside the queried region.
+//!
+//! There are queries for frustums, boxes, spheres and rays. Other searches, such as branch and
+//! bound, can be written with traverse(). The visitors are template parameters, and the queries
+//! share a scratch stack per thread, so a query does not allocate once the stack has grown to the
+//! depth of the tree. Visitors may query the same tree again.
+//!
+//! The tree over all display objects is protected by DisplayObject::m. Queries don't modify the
+//! tree, so several threads may query it at once while holding the mutex shared.
+class BoundingTree
+{
+public:
+    //! Constructs an empty tree.
+    BoundingTree();
+
+    //! \brief Inserts a leaf.
+    //! \return The leaf node, to be used with update() and remove().
+    uint insert(const QVector3D &center, float radius, uint data);
+
+    //! Removes a leaf returned from insert().
+    void remove(uint leaf);
+
+    //! Changes the bounding sphere of a leaf.
+    void update(uint leaf, const QVector3D &center, float radius);
+
+    //! Removes all leaves.
+    void clear();
+
+    //! Returns the number of leaves.
+    inline uint size() const { return _size; }
+
+    //! \brief Gets the box around all leaves.
+    //! \return False if the tree is empty.
+    bool bounds(QVector3D *lo, QVector3D *hi) const;
+
+    //! \brief Calls \a visit with the value of each leaf not outside the frustum.
+    //!
+    //! The second argument is *true* if the leaf is entirely inside, in which case finer tests of
+    //! the same object can be skipped. Subtrees entirely inside are visited without further tests.
+    template <typename F>
+    void query(const Frustum &frustum, F visit) const;
+
+    //! Calls \a visit with the value of each leaf whose sphere overlaps the box.
+    template <typename F>
+    void query(const QVector3D &lo, const QVector3D &hi, F visit) const;
+
+    //! Calls \a visit with the value of each leaf whose sphere overlaps the sphere.
+    template <typename F>
+    void query(const QVector3D &center, float radius, F visit) const;
+
+    //! \brief Calls \a visit with the value of each leaf whose sphere is hit by the ray, along with
+    //! the ray parameter where it enters the sphere (zero if the origin is inside).
+    //!
+    //! The leaves are visited in no particular order. Hits behind the origin are ignored. With a
+    //! positive \a pad, the ray is thickened by that distance, i.e. all spheres and boxes are
+    //! grown by it.
+    template <typename F>
+    void raycast(const QVector3D &origin, const QVector3D &direction, F visit, float pad = 0.0) const;
+
+    //! \brief Traverses the tree depth first.
+    //!
+    //! \param enter Called with the box of each node reached and the largest leaf radius below
+    //! it. The node is skipped if it returns false.
+    //! \param visit Called with the value and the sphere of each leaf entered.
+    template <typename E, typename F>
+    void traverse(E enter, F visit) const;
+
+private:
+    struct Node
+    {
+        QVector3D lo, hi;           //!< The bounding box.
+        QVector3D center;           //!< Center of the bounding sphere, for leaves.
+        float radius;               //!< Radius of the bounding sphere, for leaves.
+        float maxRadius;            //!< The largest leaf radius below this node.
+        uint parent, left, right;   //!< Neighbouring nodes, with #left = #BOUNDINGTREE_NULL for leaves.
+        uint data;                  //!< The user value, for leaves.
+    };
+
+    std::vector<Node> nodes;
+    uint root, freeNodes, _size;
+
+    //! \brief Nodes waiting to be visited by the queries, shared by all trees of a thread. Each
+    //! query only works above the height it found the stack at, so nested queries are safe, and
+    //! queries from different threads don't disturb each other.
+    static inline std::vector<uint> &scratch()
+    {
+        static thread_local std::vector<uint> stack;
+        return stack;
+    }
+
+    static inline QVector3D minimum(const QVector3D &a, const QVector3D &b)
+    {
+        return QVector3D(std::min(a.x(), b.x()), std::min(a.y(), b.y()), std::min(a.z(), b.z()));
+    }
+
+    static inline QVector3D maximum(const QVector3D &a, const QVector3D &b)
+    {
+        return QVector3D(std::max(a.x(), b.x()), std::max(a.y(), b.y()), std::max(a.z(), b.z()));
+    }
+
+    //! Returns a node from the free list, or a new one.
+    uint allocateNode();
+
+    //! Puts a node on the free list.
+    void freeNode(uint node);
+
+    //! Links a leaf into the tree.
+    void insertLeaf(uint leaf);
+
+    //! Unlinks a leaf from the tree, freeing its parent.
+    void removeLeaf(uint leaf);
+
+    //! Recomputes the boxes from a node up to the root.
+    void refit(uint node);
+
+    //! Calls \a visit with the value of every leaf below a node.
+    template <typename F>
+    void visitAll(uint node, F visit) const;
+};
+
+
+template <typename F>
+void BoundingTree::query(const Frustum &frustum, F visit) const
+{
+    if (root == BOUNDINGTREE_NULL)
+        return;
+
+    std::vector<uint> &stack = scratch();
+    size_t base = stack.size();
+    stack.push_back(root);
+    while (stack.size() > base)
+    {
+        uint index = stack.back();
+        const Node &node = nodes[index];
+        stack.pop_back();
+
+        Containment c = frustum.classify(node.lo, node.hi);
+        if (c == CT_OUTSIDE)
+            continue;
+        if (c == CT_INSIDE)
+            visitAll(index, visit);
+        else if (node.left == BOUNDINGTREE_NULL)
+        {
+            c = frustum.classify(node.center, node.radius);
+            if (c != CT_OUTSIDE)
+                visit(node.data, c == CT_INSIDE);
+        }
+        else
+        {
+            stack.push_back(node.left);
+            stack.push_back(node.right);
+        }
+    }
+}
+
+
+template <typename F>
+void BoundingTree::query(const QVector3D &lo, const QVector3D &hi, F visit) const
+{
+    traverse(
+        [&lo, &hi] (const QVector3D &nlo, const QVector3D &nhi, float) {
+            return (nlo.x() <= hi.x() && nlo.y() <= hi.y() && nlo.z() <= hi.z() &&
+                    nhi.x() >= lo.x() && nhi.y() >= lo.y() && nhi.z() >= lo.z());
+        },
+        [&lo, &hi, &visit] (uint data, const QVector3D &center, float radius) {
+            QVector3D closest = maximum(lo, minimum(hi, center));
+            if ((closest - center).lengthSquared() <= radius * radius)
+                visit(data);
+        });
+}
+
+
+template <typename F>
+void BoundingTree::query(const QVector3D &center, float radius, F visit) const
+{
+    traverse(
+        [&center, radius] (const QVector3D &lo, const QVector3D &hi, float) {
+            QVector3D closest = maximum(lo, minimum(hi, center));
+            return (closest - center).lengthSquared() <= radius * radius;
+        },
+        [&center, radius, &visit] (uint data, const QVector3D &c, float r) {
+            if ((c - center).lengthSquared() <= (r + radius) * (r + radius))
+                visit(data);
+        });
+}
+
+
+template <typename F>
+void BoundingTree::raycast(const QVector3D &origin, const QVector3D &direction, F visit, float pad) const
+{
+    QVector3D dir = direction.normalized();
+    float inv[3] = { 1.0f / dir.x(), 1.0f / dir.y(), 1.0f / dir.z() };
+    float o[3] = { origin.x(), origin.y(), origin.z() };
+
+    traverse(
+        [&o, &inv, pad] (const QVector3D &lo, const QVector3D &hi, float) {
+            // Slab test, relying on infinities for axis-parallel rays
+            float tMin = 0.0, tMax = INFINITY;
+            float l[3] = { lo.x() - pad, lo.y() - pad, lo.z() - pad };
+            float h[3] = { hi.x() + pad, hi.y() + pad, hi.z() + pad };
+            for (int i = 0; i < 3; i++)
+            {
+                float t0 = (l[i] - o[i]) * inv[i], t1 = (h[i] - o[i]) * inv[i];
+                if (t0 > t1)
+                    std::swap(t0, t1);
+                tMin = std::max(tMin, t0);
+                tMax = std::min(tMax, t1);
+            }
+            return tMin <= tMax;
+        },
+        [&origin, &dir, &visit, pad] (uint data, const QVector3D &center, float radius) {
+            radius += pad;
+            QVector3D oc = center - origin;
+            float b = QVector3D::dotProduct(oc, dir);
+            float disc = b * b - oc.lengthSquared() + radius * radius;
+            if (disc < 0.0)
+                return;
+            float t = b - std::sqrt(disc);
+            if (t < 0.0)
+            {
+                if (b + std::sqrt(disc) < 0.0)
+                    return;
+                t = 0.0;
+            }
+            visit(data, t);
+        });
+}
+
+
+template <typename E, typename F>
+void BoundingTree::traverse(E enter, F visit) const
+{
+    if (root == BOUNDINGTREE_NULL)
+        return;
+
+    std::vector<uint> &stack = scratch();
+    size_t base = stack.size();
+    stack.push_back(root);
+    while (stack.size() > base)
+    {
+        const Node &node = nodes[stack.back()];
+        stack.pop_back();
+
+        if (!enter(node.lo, node.hi, node.maxRadius))
+            continue;
+
+        if (node.left == BOUNDINGTREE_NULL)
+            visit(node.data, node.center, node.radius);
+        else
+        {
+            stack.push_back(node.left);
+            stack.push_back(node.right);
+        }
+    }
+}
+
+
+template <typename F>
+void BoundingTree::visitAll(uint node, F visit) const
+{
+    std::vector<uint> &stack = scratch();
+    size_t base = stack.size();
+    stack.push_back(node);
+    while (stack.size() > base)
+    {
+        const Node &n = nodes[stack.back()];
+        stack.pop_back();
+
+        if (n.left == BOUNDINGTREE_NULL)
+            visit(n.data, true);
+        else
+        {
+            stack.push_back(n.left);
+            stack.push_back(n.right);
+        }
+    }
+}
+
+#endif /* _BOUNDINGTREE_H_ */
@@ -0,0 +1,130 @@
+/*
+ * Copyright (C) 2014 SINTEF ICT,
+ * Applied Mathematics, Norway.
+ *
+ * Contact information:
+ * E-mail: eivind.fonn@sintef.no
+ * SINTEF ICT, Department of Applied Mathematics,
+ * P.O. Box 4760 Sluppen,
+ * 7045 Trondheim, Norway.
+ *
+ * This file is part of BSGUI.
+ *
+ * BSGUI is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * BSGUI is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public
+ * License along with GoTools. If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In accordance with Section 7(b) of the GNU Affero General Public
+ * License, a covered work must retain the producer line in every data
+ * file that is created or manipulated using GoTools.
+ *
+ * Other Usage
+ * You can be released from the requirements of the license by purchasing
+ * a commercial license. Buying such a license is mandatory as soon as you
+ * develop commercial activities involving the GoTools library without
+ * disclosing the source code of your own applications.
+ *
+ * This file may be used in accordance with the terms contained in a
+ * written agreement between you and SINTEF ICT.
+ */
+
+#include <algorithm>
+
+#include "ComponentSet.h"
+
+
+ComponentSet::ComponentSet()
+    : _range(0)
+{
+}
+
+
+ComponentSet::ComponentSet(uint range)
+    : words((range + 63) / 64, 0)
+    , _range(range)
+{
+}
+
+
+ComponentSet::ComponentSet(std::initializer_list<uint> members)
+    : _range(0)
+{
+    if (members.size() > 0)
+        resize(*std::max_element(members.begin(), members.end()) + 1);
+    for (auto i : members)
+        insert(i);
+}
+
+
+void ComponentSet::resize(uint range)
+{
+    words.resize((range + 63) / 64, 0);
+    _range = range;
+    if (range % 64)
+        words.back() &= ((uint64_t) 1 << (range % 64)) - 1;
+}
+
+
+uint ComponentSet::count() const
+{
+    uint n = 0;
+    for (auto w : words)
+        n += __builtin_popcountll(w);
+    return n;
+}
+
+
+bool ComponentSet::empty() const
+{
+    return std::all_of(words.begin(), words.end(), [] (uint64_t w) { return w == 0; });
+}
+
+
+void ComponentSet::clear()
+{
+    std::fill(words.begin(), words.end(), 0);
+}
+
+
+void ComponentSet::fill()
+{
+    std::fill(words.begin(), words.end(), ~(uint64_t) 0);
+    resize(_range);
+}
+
+
+void ComponentSet::unite(const ComponentSet &other)
+{
+    if (other._range > _range)
+        resize(other._range);
+    for (size_t k = 0; k < other.words.size(); k++)
+        words[k] |= other.words[k];
+}
+
+
+void ComponentSet::uniteWord(size_t k, uint64_t bits)
+{
+    if (!bits)
+        return;
+    uint top = 64 * k + 63 - __builtin_clzll(bits);
+    if (top >= _range)
+        resize(top + 1);
+    words[k] |= bits;
+}
+
+
+void ComponentSet::subtract(const ComponentSet &other)
+{
+    for (size_t k = 0; k < std::min(words.size(), other.words.size()); k++)
+        words[k] &= ~other.words[k];
+}
@@ -0,0 +1,203 @@
+/*
+ * Copyright (C) 2014 SINTEF ICT,
+ * Applied Mathematics, Norway.
+ *
+ * Contact information:
+ * E-mail: eivind.fonn@sintef.no
+ * SINTEF ICT, Department of Applied Mathematics,
+ * P.O. Box 4760 Sluppen,
+ * 7045 Trondheim, Norway.
+ *
+ * This file is part of BSGUI.
+ *
+ * BSGUI is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * BSGUI is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public
+ * License along with GoTools. If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In accordance with Section 7(b) of the GNU Affero General Public
+ * License, a covered work must retain the producer line in every data
+ * file that is created or manipulated using GoTools.
+ *
+ * Other Usage
+ * You can be released from the requirements of the license by purchasing
+ * a commercial license. Buying such a license is mandatory as soon as you
+ * develop commercial activities involving the GoTools library without
+ * disclosing the source code of your own applications.
+ *
+ * This file may be used in accordance with the terms contained in a
+ * written agreement between you and SINTEF ICT.
+ */
+
+#include <cstdint>
+#include <initializer_list>
+#include <iterator>
+#include <vector>
+
+#ifndef _COMPONENTSET_H_
+#define _COMPONENTSET_H_
+
+typedef unsigned int uint;
+
+//! \brief A set of component numbers (faces, edges or points of a DisplayObject), stored as a
+//! bitset.
+//!
+//! The set has a range, normally the number of components, and only numbers below it can be
+//! members. Inserting a number outside the range grows it. Bulk operations work a word of 64
+//! components at a time, and visiting the members or the runs of consecutive members skips empty
+//! words, so neither allocates.
+class ComponentSet
+{
+public:
+    //! Iterates over the members in increasing order.
+    class const_iterator
+    {
+    public:
+        typedef std::forward_iterator_tag iterator_category;
+        typedef uint value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef const uint *pointer;
+        typedef uint reference;
+
+        inline const_iterator(const ComponentSet *set, size_t word)
+            : set(set), word(word), bits(word < set->words.size() ? set->words[word] : 0) { skip(); }
+
+        inline uint operator*() const { return 64 * word + __builtin_ctzll(bits); }
+        inline const_iterator &operator++() { bits &= bits - 1; skip(); return *this; }
+        inline const_iterator operator++(int) { const_iterator it = *this; ++*this; return it; }
+        inline bool operator==(const const_iterator &other) const
+        {
+            return word == other.word && bits == other.bits;
+        }
+        inline bool operator!=(const const_iterator &other) const { return !(*this == other); }
+
+    private:
+        //! Moves to the next word with members, if the current one has none left.
+        inline void skip()
+        {
+            while (!bits && word < set->words.size())
+                if (++word < set->words.size())
+                    bits = set->words[word];
+        }
+
+        const ComponentSet *set;
+        size_t word;
+        uint64_t bits;
+    };
+
+    //! Constructs an empty set with range zero.
+    ComponentSet();
+
+    //! Constructs an empty set with the given range.
+    explicit ComponentSet(uint range);
+
+    //! Constructs a set with the given members, and range one past the largest.
+    ComponentSet(std::initializer_list<uint> members);
+
+    //! Changes the range, dropping any members outside it.
+    void resize(uint range);
+
+    //! Returns the range.
+    inline uint range() const { return _range; }
+
+    //! Returns the number of members.
+    uint count() const;
+
+    //! Checks whether there are no members.
+    bool empty() const;
+
+    //! Returns the members from 64 \a k up to 64 \a k + 63 as the bits of a word.
+    inline uint64_t word(size_t k) const { return k < words.size() ? words[k] : 0; }
+
+    //! Adds the members given by the bits of a word, as returned by word().
+    void uniteWord(size_t k, uint64_t bits);
+
+    inline bool contains(uint i) const
+    {
+        return i < _range && (words[i / 64] >> (i % 64) & 1);
+    }
+
+    inline void insert(uint i)
+    {
+        if (i >= _range)
+            resize(i + 1);
+        words[i / 64] |= (uint64_t) 1 << (i % 64);
+    }
+
+    inline void erase(uint i)
+    {
+        if (i < _range)
+            words[i / 64] &= ~((uint64_t) 1 << (i % 64));
+    }
+
+    //! Removes all members.
+    void clear();
+
+    //! Makes every number in the range a member.
+    void fill();
+
+    //! Adds the members of another set, growing the range if needed.
+    void unite(const ComponentSet &other);
+
+    //! Removes the members of another set.
+    void subtract(const ComponentSet &other);
+
+    inline const_iterator begin() const { return const_iterator(this, 0); }
+    inline const_iterator end() const { return const_iterator(this, words.size()); }
+
+    //! \brief Calls \a visit with each maximal range [from, to) of consecutive members.
+    //!
+    //! If \a mask is given, only members that are also in the mask (if \a in is true), or not in
+    //! the mask (if \a in is false) are considered. The mask is applied word by word, so splitting
+    //! a set in two by another costs no more than visiting it.
+    template <typename F>
+    void runs(F visit, const ComponentSet *mask = NULL, bool in = true) const
+    {
+        uint start = 0;
+        bool open = false;
+
+        for (size_t k = 0; k < words.size(); k++)
+        {
+            uint64_t w = words[k];
+            if (mask)
+            {
+                uint64_t m = k < mask->words.size() ? mask->words[k] : 0;
+                w &= in ? m : ~m;
+            }
+
+            // Alternately find the next member, and the next non-member after it
+            uint bit = 0;
+            while (bit < 64)
+            {
+                uint64_t rest = (open ? ~w : w) >> bit;
+                if (!rest)
+                    break;
+                bit += __builtin_ctzll(rest);
+                if (open)
+                    visit(start, (uint) (64 * k + bit));
+                else
+                    start = 64 * k + bit;
+                open = !open;
+            }
+        }
+
+        if (open)
+            visit(start, _range);
+    }
+
+private:
+    //! The bits, with those at or above #_range always zero.
+    std::vector<uint64_t> words;
+    uint _range;
+};
+
+#endif /* _COMPONENTSET_H_ */
@@ -38,6 +38,13 @@
  * written agreement between you and SINTEF ICT.
  */
 
+#include <algorithm>
+#include <cmath>
+#include <tuple>
+
+#include <QOpenGLContext>
+#include <QOpenGLFunctions_3_2_Core>
+
 #include "DisplayObject.h"
 
 const QVector3D FACE_COLOR_NORMAL    = QVector3D(0.737, 0.929, 1.000);
@@ -50,7 +57,7 @@ const QVector3D LINE_COLOR_SELECTED  = QVector3D(0.749, 0.620, 0.431);
 const QVector3D EDGE_COLOR_SELECTED  = QVector3D(0.776, 0.478, 0.427);
 const QVector3D POINT_COLOR_SELECTED = QVector3D(0.776, 0.478, 0.427);
 
-const QVector3D WHITE = QVector3D(1.0, 1.0, 1.0);
+const QVector3D HOVER_COLOR          = QVector3D(1.000, 0.600, 0.000);
 
 
 #define LINE_WIDTH 1.1
@@ -59,22 +66,58 @@ const QVector3D WHITE = QVector3D(1.0, 1.0, 1.0);
 
 
 uint DisplayObject::nextIndex = 0;
+uint DisplayObject::lastRequest = 0;
+bool DisplayObject::_compact = false;
+bool DisplayObject::_lowMemory = false;
+bool DisplayObject::_occlusionCulling = false;
+std::vector<GLuint> DisplayObject::queryPool;
+GLuint DisplayObject::boxBuffer = 0;
+GLuint DisplayObject::boxArray = 0;
 std::map<uint, DisplayObject *> DisplayObject::indexMap;
-std::mutex DisplayObject::m;
+std::set<uint> DisplayObject::pendingUploads;
+GeometryArena DisplayObject::vertexArena[2] = {
+    GeometryArena(QOpenGLBuffer::VertexBuffer, VERTEX_PAGE * sizeof(fullVertex)),
+    GeometryArena(QOpenGLBuffer::VertexBuffer, VERTEX_PAGE * sizeof(packedVertex))
+};
+GeometryArena DisplayObject::pageArena[2] = {
+    GeometryArena(QOpenGLBuffer::VertexBuffer, sizeof(GLuint)),
+    GeometryArena(QOpenGLBuffer::VertexBuffer, sizeof(GLuint))
+};
+GLuint DisplayObject::pageTextures[2] = {0, 0};
+uint DisplayObject::pageGenerations[2] = {0, 0};
+GeometryArena DisplayObject::indexArena(QOpenGLBuffer::IndexBuffer, sizeof(GLuint));
+GeometryArena DisplayObject::quantArena(QOpenGLBuffer::VertexBuffer, 4 * sizeof(GLfloat));
+GLuint DisplayObject::quantTexture = 0;
+uint DisplayObject::quantGeneration = 0;
+GeometryArena DisplayObject::rangeArena(QOpenGLBuffer::VertexBuffer, sizeof(GLuint));
+GLuint DisplayObject::rangeTexture = 0;
+uint DisplayObject::rangeGeneration = 0;
+GeometryArena DisplayObject::flagArena(QOpenGLBuffer::VertexBuffer, sizeof(GLubyte));
+GLuint DisplayObject::flagTexture = 0;
+uint DisplayObject::flagGeneration = 0;
+GeometryArena DisplayObject::objectArena(QOpenGLBuffer::VertexBuffer, 4 * sizeof(GLuint));
+GLuint DisplayObject::objectTexture = 0;
+uint DisplayObject::objectGeneration = 0;
+std::set<uint> DisplayObject::pendingFlags;
+BoundingTree DisplayObject::boundingTree;
+GLuint DisplayObject::arenaArrays[2] = {0, 0};
+std::pair<uint,uint> DisplayObject::arrayGenerations[2];
+DisplayObject::Locations DisplayObject::locations[4];
+SharedMutex DisplayObject::m;
 
 
 DisplayObject::DisplayObject()
     : _initialized(false)
-    , vertexBuffer(QOpenGLBuffer::VertexBuffer)
-    , normalBuffer(QOpenGLBuffer::VertexBuffer)
-    , faceBuffer(QOpenGLBuffer::IndexBuffer)
-    , elementBuffer(QOpenGLBuffer::IndexBuffer)
-    , edgeBuffer(QOpenGLBuffer::IndexBuffer)
-    , pointBuffer(QOpenGLBuffer::IndexBuffer)
+    , _bufferCompact(false)
+    , _geometryReleased(false)
+    , boundingLeaf(BOUNDINGTREE_NULL)
+    , occlusionQuery(0)
+    , queryIssued(false)
+    , occluded(false)
+    , indexType(GL_UNSIGNED_INT)
+    , _quality(1.0)
+    , _request(0)
     , _patch(NULL)
-    , selectedFaces {}
-    , selectedEdges {}
-    , selectedPoints {}
 {
     _index = registerObject(this);
 }
@@ -83,247 +126,1055 @@ DisplayObject::DisplayObject()
 DisplayObject::~DisplayObject()
 {
     deregisterObject(_index);
+    pendingUploads.erase(_index);
+    pendingFlags.erase(_index);
 
     if (_initialized)
     {
         _initialized = false;
-
-        vertexBuffer.destroy();
-        normalBuffer.destroy();
-        faceBuffer.destroy();
-        elementBuffer.destroy();
-        edgeBuffer.destroy();
-        pointBuffer.destroy();
+        freeBlocks();
     }
+
+    if (boundingLeaf != BOUNDINGTREE_NULL)
+        boundingTree.remove(boundingLeaf);
+
+    // Queries can only be deleted with a current context, so keep them for other objects
+    if (occlusionQuery)
+        queryPool.push_back(occlusionQuery);
 }
 
 
 void DisplayObject::initialize()
 {
-    if (_initialized)
+    if (pending)
+    {
+        geometry = std::move(*pending);
+        pending.reset();
+        _geometryReleased = false;
+        computeBoundingSphere();
+        updateBounds();
+    }
+    else if (_initialized && _bufferCompact == _compact)
         return;
+    else
+        ensureGeometry();
+
+    if (_initialized)
+        freeBlocks();
+    _bufferCompact = _compact;
+
+    // Writing to the arenas is ordered after any draw calls already issued, so the old blocks
+    // can be reused right away
+    uint nVertices = geometry.vertexData.size();
+
+    if (_bufferCompact)
+    {
+        float scale = std::max(2 * _radius, 1e-30f);
+        QVector3D offset = _center - QVector3D(_radius, _radius, _radius);
+
+        std::vector<packedVertex> packed(nVertices);
+        for (size_t i = 0; i < nVertices; i++)
+        {
+            QVector3D p = (geometry.vertexData[i] - offset) / scale * 65535.0;
+            packed[i].x = (GLushort) std::min(std::max(std::round(p.x()), 0.0f), 65535.0f);
+            packed[i].y = (GLushort) std::min(std::max(std::round(p.y()), 0.0f), 65535.0f);
+            packed[i].z = (GLushort) std::min(std::max(std::round(p.z()), 0.0f), 65535.0f);
+
+            // Octahedral encoding: project onto the octahedron, and fold the lower half over
+            QVector3D n = geometry.normalData[i];
+            float l1 = std::abs(n.x()) + std::abs(n.y()) + std::abs(n.z());
+            float nx = l1 > 0 ? n.x() / l1 : 0.0, ny = l1 > 0 ? n.y() / l1 : 0.0;
+            if (n.z() < 0)
+            {
+                float fx = (1.0 - std::abs(ny)) * (nx >= 0 ? 1.0 : -1.0);
+                float fy = (1.0 - std::abs(nx)) * (ny >= 0 ? 1.0 : -1.0);
+                nx = fx;
+                ny = fy;
+            }
+            packed[i].nx = (GLbyte) std::round(nx * 127.0);
+            packed[i].ny = (GLbyte) std::round(ny * 127.0);
+        }
+
+        vertexBlock = vertexArena[1].allocate(nVertices * sizeof(packedVertex));
+        vertexArena[1].write(vertexBlock, &packed[0], nVertices * sizeof(packedVertex));
+
+        GLfloat box[4] = { offset.x(), offset.y(), offset.z(), scale };
+        quantArena.reserve((_index + 1) * sizeof(box));
+        quantArena.write(_index * sizeof(box), box, sizeof(box));
+    }
+    else
+    {
+        std::vector<fullVertex> full(nVertices);
+        for (size_t i = 0; i < nVertices; i++)
+        {
+            const QVector3D &p = geometry.vertexData[i], &n = geometry.normalData[i];
+            full[i] = { p.x(), p.y(), p.z(), n.x(), n.y(), n.z() };
+        }
 
-    createBuffer(vertexBuffer);
-    vertexBuffer.allocate(&vertexData[0], 3 * vertexData.size() * sizeof(float));
+        vertexBlock = vertexArena[0].allocate(nVertices * sizeof(fullVertex));
+        vertexArena[0].write(vertexBlock, &full[0], nVertices * sizeof(fullVertex));
+    }
 
-    createBuffer(normalBuffer);
-    normalBuffer.allocate(&normalData[0], 3 * normalData.size() * sizeof(float));
+    // The pages of the vertex block belong to this object
+    GLint base = baseVertex();
+    uint firstPage = base / VERTEX_PAGE, nPages = (nVertices + VERTEX_PAGE - 1) / VERTEX_PAGE;
+    if (nPages > 0)
+    {
+        std::vector<GLuint> owners(nPages, _index);
+        GeometryArena &pages = pageArena[_bufferCompact ? 1 : 0];
+        pages.reserve((firstPage + nPages) * sizeof(GLuint));
+        pages.write(firstPage * sizeof(GLuint), &owners[0], nPages * sizeof(GLuint));
+    }
 
-    createBuffer(faceBuffer);
-    faceBuffer.allocate(&faceData[0], 4 * faceData.size() * sizeof(GLuint));
+    indexType = (_bufferCompact && nVertices < 65536) ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+
+    // All the indices of the object go in one block
+    std::vector<GLuint> indices(geometry.faceData.begin(), geometry.faceData.end());
+    elementStart = indices.size();
+    for (auto l : geometry.elementData)
+        indices.insert(indices.end(), { l.a, l.b });
+    edgeStart = indices.size();
+    for (auto l : geometry.edgeData)
+        indices.insert(indices.end(), { l.a, l.b });
+    pointStart = indices.size();
+    indices.insert(indices.end(), geometry.pointData.begin(), geometry.pointData.end());
+    faceStart = 0;
+
+    // Narrowing to 16 bits maps PRIMITIVE_RESTART to 0xFFFF
+    if (indexType == GL_UNSIGNED_SHORT)
+    {
+        std::vector<GLushort> narrow(indices.begin(), indices.end());
+        indexBlock = indexArena.allocate(narrow.size() * sizeof(GLushort));
+        indexArena.write(indexBlock, &narrow[0], narrow.size() * sizeof(GLushort));
+    }
+    else
+    {
+        indexBlock = indexArena.allocate(indices.size() * sizeof(GLuint));
+        indexArena.write(indexBlock, &indices[0], indices.size() * sizeof(GLuint));
+    }
 
-    createBuffer(elementBuffer);
-    elementBuffer.allocate(&elementData[0], 2 * elementData.size() * sizeof(GLuint));
+    // The vertices of each face, for the shaders (see Tessellation::faceData), and the line
+    // bounds of the edges
+    std::vector<GLuint> ranges;
+    for (uint f = 0; f < nFaces(); f++)
+    {
+        GLuint first = nVertices, last = 0;
+        for (uint i = geometry.faceIdxs[f]; i < geometry.faceIdxs[f+1]; i++)
+            if (geometry.faceData[i] != PRIMITIVE_RESTART)
+            {
+                first = std::min(first, geometry.faceData[i]);
+                last = std::max(last, geometry.faceData[i] + 1);
+            }
+        first = std::min(first, last);
+        ranges.insert(ranges.end(), { base + first, base + last });
+    }
+    ranges.insert(ranges.end(), geometry.edgeIdxs.begin(), geometry.edgeIdxs.end());
+    rangeBlock = rangeArena.allocate(std::max(ranges.size(), (size_t) 1) * sizeof(GLuint));
+    if (!ranges.empty())
+        rangeArena.write(rangeBlock, &ranges[0], ranges.size() * sizeof(GLuint));
 
-    createBuffer(edgeBuffer);
-    edgeBuffer.allocate(&edgeData[0], 2 * edgeData.size() * sizeof(GLuint));
+    flagBlock = flagArena.allocate(std::max(nFaces() + nEdges() + nPoints(), 1u));
+    writeFlags();
+    pendingFlags.erase(_index);
 
-    createBuffer(pointBuffer);
-    pointBuffer.allocate(&pointData[0], pointData.size() * sizeof(GLuint));
+    GLuint tables[4] = { (GLuint) (rangeBlock / sizeof(GLuint)), flagBlock, nFaces(), nEdges() };
+    objectArena.reserve((_index + 1) * sizeof(tables));
+    objectArena.write(_index * sizeof(tables), tables, sizeof(tables));
 
     _initialized = true;
+
+    if (_lowMemory)
+        releaseGeometry();
+}
+
+
+void DisplayObject::ensureGeometry()
+{
+    if (!_geometryReleased)
+        return;
+
+    // A fresh tessellation at the uploaded quality reproduces the released data
+    Tessellation regenerated;
+    regenerationJob()(regenerated);
+    geometry = std::move(regenerated);
+    _geometryReleased = false;
+}
+
+
+std::function<void(Tessellation &)> DisplayObject::regenerationJob()
+{
+    if (!_geometryReleased)
+        return std::function<void(Tessellation &)>();
+    return stampedJob(geometry.quality);
+}
+
+
+std::function<void(Tessellation &)> DisplayObject::stampedJob(float quality)
+{
+    auto job = tessellationJob(quality);
+    return [job, quality] (Tessellation &data) {
+        job(data);
+        data.quality = quality;
+    };
+}
+
+
+void DisplayObject::releaseGeometry()
+{
+    std::vector<QVector3D>().swap(geometry.vertexData);
+    std::vector<QVector3D>().swap(geometry.normalData);
+    std::vector<GLuint>().swap(geometry.faceData);
+    std::vector<pair>().swap(geometry.elementData);
+    std::vector<pair>().swap(geometry.edgeData);
+    std::vector<GLuint>().swap(geometry.pointData);
+    _geometryReleased = true;
+}
+
+
+std::function<void(Tessellation &)> DisplayObject::requestTessellation(float quality, uint *request)
+{
+    *request = _request = ++lastRequest;
+    _quality = quality;
+
+    return stampedJob(quality);
+}
+
+
+bool DisplayObject::setTessellation(uint request, Tessellation *data)
+{
+    if (request != _request)
+        return false;
+
+    pending.reset(data);
+    pendingUploads.insert(_index);
+    return true;
+}
+
+
+void DisplayObject::tessellate(float quality)
+{
+    _quality = quality;
+    stampedJob(quality)(geometry);
+    computeBoundingSphere();
+    updateBounds();
 }
 
 
-void drawCommand(GLenum mode, const std::set<uint> &visible, int n, std::vector<uint> indices)
+void DisplayObject::updateBounds()
 {
-    uint mult = mode == GL_QUADS ? 4 : 2;
-    if (visible.size() == n)
-        glDrawElements(mode, mult*indices[n], GL_UNSIGNED_INT, 0);
+    const std::vector<Tile> &tiles = geometry.tiles;
+    if (tileLeaves.size() == tiles.size())
+        for (uint i = 0; i < tiles.size(); i++)
+            tileTree.update(tileLeaves[i], tiles[i].center, tiles[i].radius);
     else
-        for (auto i : visible)
-        {
-            glDrawElements(mode, mult*(indices[i+1] - indices[i]), GL_UNSIGNED_INT,
-                           (void *) (mult * indices[i] * sizeof(GLuint)));
-        }
+    {
+        tileTree.clear();
+        tileLeaves.resize(tiles.size());
+        for (uint i = 0; i < tiles.size(); i++)
+            tileLeaves[i] = tileTree.insert(tiles[i].center, tiles[i].radius, i);
+    }
+
+    updateLeaf();
 }
 
 
-void drawCommandPts(const std::set<uint> &visible, int n)
+void DisplayObject::updateLeaf()
 {
-    if (visible.size() == n)
-        glDrawElements(GL_POINTS, n, GL_UNSIGNED_INT, 0);
+    if (isInvisible(true))
+    {
+        if (boundingLeaf != BOUNDINGTREE_NULL)
+            boundingTree.remove(boundingLeaf);
+        boundingLeaf = BOUNDINGTREE_NULL;
+    }
+    else if (boundingLeaf == BOUNDINGTREE_NULL)
+        boundingLeaf = boundingTree.insert(_center, _radius, _index);
     else
-        for (auto i : visible)
-            glDrawElements(GL_POINTS, 1, GL_UNSIGNED_INT, (void *) (i * sizeof(GLuint)));
+        boundingTree.update(boundingLeaf, _center, _radius);
 }
 
 
-void sortSelection(const std::set<uint> &selected, const std::set<uint> &visible,
-                   std::set<uint> &outSel, std::set<uint> &outUnsel)
+inline size_t indexSize(GLenum type)
 {
-    outSel.clear();
-    outUnsel.clear();
+    return type == GL_UNSIGNED_SHORT ? sizeof(GLushort) : sizeof(GLuint);
+}
 
-    for (auto f : visible)
-        if (selected.find(f) != selected.end())
-            outSel.insert(f);
-        else
-            outUnsel.insert(f);
+
+inline QOpenGLFunctions_3_2_Core *functions()
+{
+    return QOpenGLContext::currentContext()->versionFunctions<QOpenGLFunctions_3_2_Core>();
 }
 
 
-void DisplayObject::draw(QMatrix4x4 &mvp, QOpenGLShaderProgram &prog, bool showPoints)
+//! Draws the visible components, with one draw call for each run of consecutive ones.
+void drawCommand(GLenum mode, GLenum type, size_t first, GLint base,
+                 const ComponentSet &visible, const std::vector<uint> &indices)
 {
-    if (!_initialized)
-        return;
+    QOpenGLFunctions_3_2_Core *gl = functions();
 
-    std::set<uint> sel, unsel;
+    uint mult = mode == GL_LINES ? 2 : 1;
+    visible.runs([&] (uint from, uint to) {
+        gl->glDrawElementsBaseVertex(mode, mult * (indices[to] - indices[from]), type,
+                                     (void *) (first + mult * indices[from] * indexSize(type)), base);
+    });
+}
+
+
+void drawCommandPts(GLenum type, size_t first, GLint base, const ComponentSet &visible)
+{
+    QOpenGLFunctions_3_2_Core *gl = functions();
+    visible.runs([&] (uint from, uint to) {
+        gl->glDrawElementsBaseVertex(GL_POINTS, to - from, type,
+                                     (void *) (first + from * indexSize(type)), base);
+    });
+}
 
-    prog.bind();
 
-    bindBuffer(prog, vertexBuffer, "vertexPosition");
-    bindBuffer(prog, normalBuffer, "vertexNormal");
+enum DrawPass { PASS_FACES, PASS_LINES, PASS_EDGES, PASS_POINTS };
 
 
-    faceBuffer.bind();
-    sortSelection(selectedFaces, visibleFaces, sel, unsel);
+//! Draw calls sharing pass, normal offset and index type.
+struct DisplayObject::DrawList
+{
+    typedef std::tuple<uint, float, GLenum> Key;
 
-    for (auto off : faceOffsets)
+    struct Batch
+    {
+        std::vector<GLsizei> counts;
+        std::vector<const GLvoid *> offsets;
+        std::vector<GLint> bases;
+    };
+
+    std::map<Key, Batch> batches;
+
+    //! \brief Adds the range [\a from, \a to) of indices, in units of \a mult indices, merging it
+    //! with the previous range of the batch if they are adjacent.
+    //!
+    //! Ranges of different objects never merge, since their base vertices differ. This keeps the
+    //! edge and point ranges of each object starting at its first component, as the shader
+    //! numbers them by the primitive ID.
+    void addRange(DrawPass pass, float p, GLenum type, size_t first, GLint base,
+                  uint from, uint to, uint mult)
     {
-        setUniforms(prog, mvp, FACE_COLOR_SELECTED, off);
-        drawCommand(GL_QUADS, sel, nFaces(), faceIdxs);
-        setUniforms(prog, mvp, FACE_COLOR_NORMAL, off);
-        drawCommand(GL_QUADS, unsel, nFaces(), faceIdxs);
+        if (from == to)
+            return;
+
+        Batch &batch = batches[Key(pass, p, type)];
+        GLsizei count = mult * (to - from);
+        size_t offset = first + mult * from * indexSize(type);
+
+        if (!batch.counts.empty() && batch.bases.back() == base &&
+            (size_t) batch.offsets.back() + batch.counts.back() * indexSize(type) == offset)
+            batch.counts.back() += count;
+        else
+        {
+            batch.counts.push_back(count);
+            batch.offsets.push_back((const GLvoid *) offset);
+            batch.bases.push_back(base);
+        }
+    }
+
+    //! Empties the batches, keeping their storage for the next frame.
+    void clear()
+    {
+        for (auto &b : batches)
+        {
+            b.second.counts.clear();
+            b.second.offsets.clear();
+            b.second.bases.clear();
+        }
     }
 
+    //! Checks whether there is nothing to draw.
+    bool empty() const
+    {
+        for (auto &b : batches)
+            if (!b.second.counts.empty())
+                return false;
+        return true;
+    }
+};
+
+
+DisplayObject::DrawList DisplayObject::frameList;
+DisplayObject::DrawList DisplayObject::occludedList;
+std::vector<std::pair<DisplayObject *, bool>> DisplayObject::occlusionTested;
+std::vector<GLfloat> DisplayObject::occlusionBoxes;
+std::vector<uint> DisplayObject::tilesInside;
+std::vector<GLubyte> DisplayObject::flagData;
+
+
+void DisplayObject::addDraws(DrawList &list, bool showPoints, const Frustum *frustum)
+{
+    if (!_initialized || _bufferCompact != _compact)
+        return;
 
-    elementBuffer.bind();
-    glLineWidth(LINE_WIDTH);
+    GLint base = baseVertex();
 
-    for (auto off : lineOffsets)
+    // The shader takes the colors from the flags, so selection changes nothing here
+    if (!frustum || geometry.tiles.empty())
+    {
+        visibleFaces.runs([&] (uint from, uint to) {
+            for (auto p : faceOffsets)
+                list.addRange(PASS_FACES, p, indexType, indexOffset(faceStart), base,
+                              geometry.faceIdxs[from], geometry.faceIdxs[to], 1);
+            for (auto p : lineOffsets)
+                list.addRange(PASS_LINES, p, indexType, indexOffset(elementStart), base,
+                              geometry.elementIdxs[from], geometry.elementIdxs[to], 2);
+        });
+    }
+    else
     {
-        setUniforms(prog, mvp, LINE_COLOR_SELECTED, off);
-        drawCommand(GL_LINES, sel, nFaces(), elementIdxs);
-        setUniforms(prog, mvp, LINE_COLOR_NORMAL, off);
-        drawCommand(GL_LINES, unsel, nFaces(), elementIdxs);
+        // The object straddles the frustum, so only draw the tiles of visible faces inside it.
+        // Sorting lets adjacent tiles merge into one range.
+        std::vector<uint> &inside = tilesInside;
+        inside.clear();
+        tileTree.query(*frustum, [this, &inside] (uint i, bool) {
+            if (visibleFaces.contains(geometry.tiles[i].face))
+                inside.push_back(i);
+        });
+        std::sort(inside.begin(), inside.end());
+
+        for (auto p : faceOffsets)
+            for (auto i : inside)
+                list.addRange(PASS_FACES, p, indexType, indexOffset(faceStart), base,
+                              geometry.tiles[i].faceBegin, geometry.tiles[i].faceEnd, 1);
+        for (auto p : lineOffsets)
+            for (auto i : inside)
+                list.addRange(PASS_LINES, p, indexType, indexOffset(elementStart), base,
+                              geometry.tiles[i].elementBegin, geometry.tiles[i].elementEnd, 2);
     }
 
+    // Edges and points are found from the primitive ID, so their ranges start at the first one
+    if (!visibleEdges.empty())
+        for (auto p : edgeOffsets)
+            list.addRange(PASS_EDGES, p, indexType, indexOffset(edgeStart), base,
+                          0, geometry.edgeIdxs.back(), 2);
+
+    if (showPoints && !visiblePoints.empty())
+        for (auto p : pointOffsets)
+            list.addRange(PASS_POINTS, p, indexType, indexOffset(pointStart), base, 0, nPoints(), 1);
+}
 
-    edgeBuffer.bind();
-    sortSelection(selectedEdges, visibleEdges, sel, unsel);
-    glLineWidth(EDGE_WIDTH);
 
-    for (auto off : edgeOffsets)
+uint DisplayObject::drawAll(QOpenGLShaderProgram &prog, const Frustum &frustum, bool showPoints,
+                            uint *culled, uint *occluded)
+{
+    DrawList &list = frameList;
+    std::vector<std::pair<DisplayObject *, bool>> &tested = occlusionTested;
+    list.clear();
+    tested.clear();
+    uint nOccluded = 0;
+
+    // Selection and visibility changes since the last frame are small writes to the flag arena
+    for (auto idx : pendingFlags)
     {
-        setUniforms(prog, mvp, EDGE_COLOR_SELECTED, off);
-        drawCommand(GL_LINES, sel, nEdges(), edgeIdxs);
-        setUniforms(prog, mvp, EDGE_COLOR_NORMAL, off);
-        drawCommand(GL_LINES, unsel, nEdges(), edgeIdxs);
+        auto i = indexMap.find(idx);
+        if (i != indexMap.end() && i->second->_initialized)
+            i->second->writeFlags();
     }
+    pendingFlags.clear();
+
+    uint nCulled = cull(frustum, [&] (DisplayObject *obj, bool inside) {
+        if (!obj->_initialized || obj->_bufferCompact != _compact)
+            return;
+
+        if (_occlusionCulling && !frustum.touchesNear(obj->_center, obj->_radius))
+        {
+            obj->readOcclusion();
+            tested.push_back(std::make_pair(obj, inside));
+            if (obj->occluded)
+            {
+                nOccluded++;
+                return;
+            }
+        }
+        else
+            obj->occluded = false;
+
+        obj->addDraws(list, showPoints, inside ? NULL : &frustum);
+    });
+
+    if (culled)
+        *culled = nCulled;
+    if (occluded)
+        *occluded = nOccluded;
 
+    if (list.empty() && tested.empty())
+        return 0;
+
+    bindArena(prog);
+    uint calls = drawList(prog, list);
+    if (!tested.empty())
+        calls += drawOccluded(prog, frustum, showPoints, tested);
+
+    return calls;
+}
+
+
+uint DisplayObject::drawList(QOpenGLShaderProgram &prog, DrawList &list)
+{
+    QOpenGLFunctions_3_2_Core *gl = functions();
 
-    if (showPoints)
+    // The map is ordered by pass, so faces are drawn first and points last. Batches are kept
+    // between frames, so some may be empty.
+    uint calls = 0;
+    for (auto &b : list.batches)
     {
-        pointBuffer.bind();
-        sortSelection(selectedPoints, visiblePoints, sel, unsel);
-        glPointSize(POINT_SIZE);
+        if (b.second.counts.empty())
+            continue;
+        calls++;
+
+        uint pass;
+        float p;
+        GLenum type;
+        std::tie(pass, p, type) = b.first;
+
+        // Element lines and edges are widened by the line program
+        bool lines = pass == PASS_LINES || pass == PASS_EDGES;
+        QOpenGLShaderProgram &use = lines ? bindLines(prog) : prog;
+        if (!lines)
+            prog.bind();
+
+        // The shader picks the color of each component from its flags
+        GLenum mode = GL_LINES;
+        switch (pass)
+        {
+        case PASS_FACES:
+            mode = GL_TRIANGLE_STRIP;
+            setColors(use, CL_FACES, FACE_COLOR_NORMAL, FACE_COLOR_SELECTED);
+            break;
+        case PASS_LINES:
+            setLineWidth(use, LINE_WIDTH);
+            setColors(use, CL_FACES, LINE_COLOR_NORMAL, LINE_COLOR_SELECTED);
+            break;
+        case PASS_EDGES:
+            setLineWidth(use, EDGE_WIDTH);
+            setColors(use, CL_EDGES, EDGE_COLOR_NORMAL, EDGE_COLOR_SELECTED);
+            break;
+        case PASS_POINTS:
+            mode = GL_POINTS;
+            glPointSize(POINT_SIZE);
+            setColors(use, CL_POINTS, POINT_COLOR_NORMAL, POINT_COLOR_SELECTED);
+            break;
+        }
+        use.setUniformValue(locationsOf(use).p, p);
 
-        for (auto off : pointOffsets)
+        gl->glPrimitiveRestartIndex(type == GL_UNSIGNED_SHORT ? 0xFFFF : PRIMITIVE_RESTART);
+        gl->glMultiDrawElementsBaseVertex(mode, &b.second.counts[0], type, &b.second.offsets[0],
+                                          b.second.counts.size(), &b.second.bases[0]);
+    }
+
+    // Other users of the programs expect a constant color
+    QOpenGLShaderProgram &lines = bindLines(prog);
+    lines.setUniformValue(locationsOf(lines).lookup, (GLint) CL_CONSTANT);
+    prog.bind();
+    prog.setUniformValue(locationsOf(prog).lookup, (GLint) CL_CONSTANT);
+
+    return calls;
+}
+
+
+uint DisplayObject::drawOccluded(QOpenGLShaderProgram &prog, const Frustum &frustum, bool showPoints,
+                                 const std::vector<std::pair<DisplayObject *, bool>> &tested)
+{
+    QOpenGLFunctions_3_2_Core *gl = functions();
+
+    // Twelve triangles over the corners of a box, with bit i of a corner selecting the upper
+    // bound along axis i
+    static const uchar triangles[36] = {
+        0, 2, 1,  1, 2, 3,  4, 5, 6,  5, 7, 6,
+        0, 1, 4,  1, 5, 4,  2, 6, 3,  3, 6, 7,
+        0, 4, 2,  2, 4, 6,  1, 3, 5,  3, 7, 5
+    };
+
+    std::vector<GLfloat> &boxes = occlusionBoxes;
+    boxes.clear();
+    for (auto &t : tested)
+    {
+        QVector3D r(t.first->_radius, t.first->_radius, t.first->_radius);
+        QVector3D lo = t.first->_center - r, hi = t.first->_center + r;
+        for (auto c : triangles)
+            boxes.insert(boxes.end(), { (c & 1) ? hi.x() : lo.x(),
+                                        (c & 2) ? hi.y() : lo.y(),
+                                        (c & 4) ? hi.z() : lo.z() });
+    }
+
+    if (!boxArray)
+    {
+        gl->glGenVertexArrays(1, &boxArray);
+        gl->glGenBuffers(1, &boxBuffer);
+        gl->glBindVertexArray(boxArray);
+        gl->glBindBuffer(GL_ARRAY_BUFFER, boxBuffer);
+        gl->glEnableVertexAttribArray(ATTRIBUTE_POSITION);
+        gl->glVertexAttribPointer(ATTRIBUTE_POSITION, 3, GL_FLOAT, GL_FALSE, 0, (const GLvoid *) 0);
+    }
+    gl->glBindVertexArray(boxArray);
+    gl->glBindBuffer(GL_ARRAY_BUFFER, boxBuffer);
+    gl->glBufferData(GL_ARRAY_BUFFER, boxes.size() * sizeof(GLfloat), &boxes[0], GL_STREAM_DRAW);
+
+    // The normal attribute is disabled here, so it is zero
+    const Locations &loc = locationsOf(prog);
+    prog.setUniformValue(loc.compact, (GLint) 0);
+    prog.setUniformValue(loc.p, 0.0f);
+
+    glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+    glDepthMask(GL_FALSE);
+    for (uint i = 0; i < tested.size(); i++)
+    {
+        DisplayObject *obj = tested[i].first;
+        if (!obj->occlusionQuery)
         {
-            setUniforms(prog, mvp, POINT_COLOR_SELECTED, off);
-            drawCommandPts(sel, nPoints());
-            setUniforms(prog, mvp, POINT_COLOR_NORMAL, off);
-            drawCommandPts(unsel, nPoints());
+            if (queryPool.empty())
+                gl->glGenQueries(1, &obj->occlusionQuery);
+            else
+            {
+                obj->occlusionQuery = queryPool.back();
+                queryPool.pop_back();
+            }
         }
+
+        gl->glBeginQuery(GL_SAMPLES_PASSED, obj->occlusionQuery);
+        gl->glDrawArrays(GL_TRIANGLES, 36 * i, 36);
+        gl->glEndQuery(GL_SAMPLES_PASSED);
+        obj->queryIssued = true;
     }
+    glDepthMask(GL_TRUE);
+    glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+
+    // The GPU skips the draws of objects whose boxes are still hidden
+    bindArena(prog);
+    uint calls = 0;
+    for (auto &t : tested)
+        if (t.first->occluded)
+        {
+            DrawList &list = occludedList;
+            list.clear();
+            t.first->addDraws(list, showPoints, t.second ? NULL : &frustum);
+
+            gl->glBeginConditionalRender(t.first->occlusionQuery, GL_QUERY_WAIT);
+            calls += drawList(prog, list);
+            gl->glEndConditionalRender();
+        }
+
+    return calls;
 }
 
 
-void DisplayObject::drawPicking(QMatrix4x4 &mvp, QOpenGLShaderProgram &prog, SelectionMode mode)
+void DisplayObject::readOcclusion()
 {
-    if (!_initialized)
+    if (!queryIssued)
+        return;
+
+    QOpenGLFunctions_3_2_Core *gl = functions();
+    GLuint available = 0, samples = 0;
+    gl->glGetQueryObjectuiv(occlusionQuery, GL_QUERY_RESULT_AVAILABLE, &available);
+    if (!available)
         return;
 
-    uint offset = 0;
+    gl->glGetQueryObjectuiv(occlusionQuery, GL_QUERY_RESULT, &samples);
+    occluded = samples == 0;
+    queryIssued = false;
+}
 
-    prog.bind();
 
-    bindBuffer(prog, vertexBuffer, "vertexPosition");
-    bindBuffer(prog, normalBuffer, "vertexNormal");
+void DisplayObject::drawPicking(QOpenGLShaderProgram &prog, SelectionMode mode)
+{
+    if (!_initialized || _bufferCompact != _compact)
+        return;
+
+    functions()->glPrimitiveRestartIndex(indexType == GL_UNSIGNED_SHORT ? 0xFFFF : PRIMITIVE_RESTART);
 
+    GLint base = baseVertex();
+    size_t faces = indexOffset(faceStart), edges = indexOffset(edgeStart), points = indexOffset(pointStart);
+    uint ranges = rangeBlock / sizeof(GLuint);
 
-    faceBuffer.bind();
     if (mode == SM_PATCH)
     {
+        setPickLookup(prog, PL_CONSTANT);
         if (nFaces() > 0)
             for (auto off : faceOffsets)
             {
-                setUniforms(prog, mvp, indexToColor(_index, offset), off);
-                drawCommand(GL_QUADS, visibleFaces, nFaces(), faceIdxs);
+                setPickUniforms(prog, _index, 0, off);
+                drawCommand(GL_TRIANGLE_STRIP, indexType, faces, base, visibleFaces, geometry.faceIdxs);
             }
         else
         {
-            edgeBuffer.bind();
-            glLineWidth(20 * EDGE_WIDTH);
+            QOpenGLShaderProgram &lines = bindLines(prog);
+            setLineWidth(lines, 20 * EDGE_WIDTH);
+            setPickLookup(lines, PL_CONSTANT);
             for (auto off : edgeOffsets)
             {
-                setUniforms(prog, mvp, indexToColor(_index, offset), off);
-                drawCommand(GL_LINES, visibleEdges, nEdges(), edgeIdxs);
+                setPickUniforms(lines, _index, 0, off);
+                drawCommand(GL_LINES, indexType, edges, base, visibleEdges, geometry.edgeIdxs);
             }
+            prog.bind();
         }
+        return;
     }
-    else if (mode == SM_FACE)
+
+    if (mode != SM_FACE && nFaces() > 0)
     {
-        for (uint f = 0; f < nFaces(); f++)
+        setPickLookup(prog, PL_CONSTANT);
+        setPickUniforms(prog, PICK_NONE, 0, 0.0);
+        drawCommand(GL_TRIANGLE_STRIP, indexType, faces, base, visibleFaces, geometry.faceIdxs);
+    }
+
+    if (mode == SM_FACE)
+    {
+        setPickLookup(prog, PL_FACE);
+        for (auto off : faceOffsets)
         {
-            if (visibleFaces.find(f) != visibleFaces.end())
-                for (auto off : faceOffsets)
-                {
-                    setUniforms(prog, mvp, indexToColor(_index, offset), off);
-                    drawCommand(GL_QUADS, {f}, nFaces(), faceIdxs);
-                }
-            offset++;
+            setPickUniforms(prog, _index, 0, off);
+            drawCommand(GL_TRIANGLE_STRIP, indexType, faces, base, visibleFaces, geometry.faceIdxs);
         }
     }
     else if (mode == SM_EDGE)
     {
-        if (nFaces() > 0)
+        QOpenGLShaderProgram &lines = bindLines(prog);
+        setLineWidth(lines, 20 * EDGE_WIDTH);
+        setPickLookup(lines, PL_RANGES, ranges + 2 * nFaces(), nEdges());
+        for (auto off : edgeOffsets)
+        {
+            setPickUniforms(lines, _index, 0, off);
+            drawPickRuns(lines, GL_LINES, edges, visibleEdges, geometry.edgeIdxs);
+        }
+        prog.bind();
+    }
+    else if (mode == SM_POINT)
+    {
+        glPointSize(POINT_SIZE);
+        setPickLookup(prog, PL_DIRECT);
+        for (auto off : pointOffsets)
+        {
+            setPickUniforms(prog, _index, 0, off);
+            drawPickRuns(prog, GL_POINTS, points, visiblePoints, {});
+        }
+    }
+}
+
+
+void DisplayObject::drawHover(QOpenGLShaderProgram &prog, SelectionMode mode, uint offset)
+{
+    if (!_initialized || _bufferCompact != _compact)
+        return;
+
+    functions()->glPrimitiveRestartIndex(indexType == GL_UNSIGNED_SHORT ? 0xFFFF : PRIMITIVE_RESTART);
+
+    QOpenGLFunctions_3_2_Core *gl = functions();
+    GLint base = baseVertex();
+
+    if (mode == SM_POINT)
+    {
+        if (offset >= nPoints())
+            return;
+        glPointSize(2 * POINT_SIZE);
+        for (auto off : pointOffsets)
         {
-            setUniforms(prog, mvp, WHITE, 0.0);
-            drawCommand(GL_QUADS, visibleFaces, nFaces(), faceIdxs);
+            setUniforms(prog, HOVER_COLOR, off);
+            size_t first = indexOffset(pointStart) + offset * indexSize(indexType);
+            gl->glDrawElementsBaseVertex(GL_POINTS, 1, indexType, (void *) first, base);
         }
+        return;
+    }
+
+    // The edges around a face are a row of the topology, and a single edge is a row of one
+    const Topology &topo = topology();
+    const uint *edges = &offset;
+    uint nHover = 0;
+    if (mode == SM_FACE && offset < nFaces())
+    {
+        edges = topo.faceEdges + topo.faceStart[offset];
+        nHover = topo.faceStart[offset+1] - topo.faceStart[offset];
+    }
+    else if (mode == SM_EDGE && offset < nEdges())
+        nHover = 1;
 
-        edgeBuffer.bind();
-        glLineWidth(20 * EDGE_WIDTH);
-        for (uint e = 0; e < nEdges(); e++)
+    QOpenGLShaderProgram &lines = bindLines(prog);
+    setLineWidth(lines, 2 * EDGE_WIDTH);
+    for (auto off : edgeOffsets)
+    {
+        setUniforms(lines, HOVER_COLOR, off);
+        if (mode == SM_PATCH)
+            drawCommand(GL_LINES, indexType, indexOffset(edgeStart), base, visibleEdges, geometry.edgeIdxs);
+        for (uint i = 0; i < nHover; i++)
         {
-            if (visibleEdges.find(e) != visibleEdges.end())
-                for (auto off : edgeOffsets)
+            uint from = geometry.edgeIdxs[edges[i]], to = geometry.edgeIdxs[edges[i]+1];
+            size_t first = indexOffset(edgeStart) + 2 * from * indexSize(indexType);
+            gl->glDrawElementsBaseVertex(GL_LINES, 2 * (to - from), indexType, (void *) first, base);
+        }
+    }
+    prog.bind();
+}
+
+
+void DisplayObject::drawPickRuns(QOpenGLShaderProgram &prog, GLenum mode, size_t first,
+                                 const ComponentSet &visible, const std::vector<uint> &indices)
+{
+    QOpenGLFunctions_3_2_Core *gl = functions();
+    GLint base = baseVertex();
+    uint mult = mode == GL_LINES ? 2 : 1;
+
+    visible.runs([&] (uint begin, uint end) {
+        uint from = indices.empty() ? begin : indices[begin];
+        uint to = indices.empty() ? end : indices[end];
+        prog.setUniformValue(locationsOf(prog).primitiveBase, (GLint) from);
+        gl->glDrawElementsBaseVertex(mode, mult * (to - from), indexType,
+                                     (void *) (first + mult * from * indexSize(indexType)), base);
+    });
+}
+
+
+//! Returns the ray parameter where the ray hits the triangle, or a negative number.
+inline float rayTriangle(const PickRay &ray, const QVector3D &a, const QVector3D &b, const QVector3D &c)
+{
+    // Moller-Trumbore, hitting both sides
+    QVector3D e1 = b - a, e2 = c - a;
+    QVector3D p = QVector3D::crossProduct(ray.direction, e2);
+    float det = QVector3D::dotProduct(e1, p);
+    if (std::abs(det) < 1e-20)
+        return -1.0;
+
+    QVector3D s = ray.origin - a;
+    float u = QVector3D::dotProduct(s, p) / det;
+    if (u < 0.0 || u > 1.0)
+        return -1.0;
+
+    QVector3D q = QVector3D::crossProduct(s, e1);
+    float v = QVector3D::dotProduct(ray.direction, q) / det;
+    if (v < 0.0 || u + v > 1.0)
+        return -1.0;
+
+    return QVector3D::dotProduct(e2, q) / det;
+}
+
+
+//! \brief Returns the ray parameter of the point on the ray closest to the segment, and the
+//! distance between them.
+inline float raySegment(const PickRay &ray, const QVector3D &a, const QVector3D &b, float *distance)
+{
+    QVector3D v = b - a, w = ray.origin - a;
+    float dv = QVector3D::dotProduct(ray.direction, v), vv = QVector3D::dotProduct(v, v);
+    float dw = QVector3D::dotProduct(ray.direction, w), vw = QVector3D::dotProduct(v, w);
+
+    float den = vv - dv * dv, s = 0.0;
+    if (den > 1e-12 * vv)
+        s = std::min(std::max((vw - dv * dw) / den, 0.0f), 1.0f);
+
+    QVector3D closest = a + s * v;
+    float t = std::max(QVector3D::dotProduct(closest - ray.origin, ray.direction), 0.0f);
+    *distance = (ray.origin + t * ray.direction - closest).length();
+    return t;
+}
+
+
+bool DisplayObject::raycast(const PickRay &ray, SelectionMode mode, float *t, uint *offset,
+                            const RegeneratedGeometry &regenerated)
+{
+    // Released geometry can only be hit through a regeneration matching the uploaded one
+    auto copy = regenerated.find(_index);
+    if (_geometryReleased && (copy == regenerated.end() || copy->second.quality != geometry.quality))
+        return false;
+    const Tessellation &data = _geometryReleased ? copy->second : geometry;
+    if (data.vertexData.empty())
+        return false;
+
+    const std::vector<QVector3D> &vertices = data.vertexData;
+    bool found = false;
+
+    // Faces, through the tiles hit by the ray
+    if (nFaces() > 0)
+        tileTree.raycast(ray.origin, ray.direction, [&] (uint i, float enter) {
+            const Tile &tile = data.tiles[i];
+            if (enter > *t || !visibleFaces.contains(tile.face))
+                return;
+
+            uint strip = 0;
+            for (uint j = tile.faceBegin; j < tile.faceEnd; j++)
+            {
+                if (data.faceData[j] == PRIMITIVE_RESTART)
                 {
-                    setUniforms(prog, mvp, indexToColor(_index, offset), off);
-                    drawCommand(GL_LINES, {e}, nEdges(), edgeIdxs);
+                    strip = 0;
+                    continue;
                 }
-            offset++;
-        }
+                if (++strip < 3)
+                    continue;
+
+                float hit = rayTriangle(ray, vertices[data.faceData[j-2]],
+                                        vertices[data.faceData[j-1]], vertices[data.faceData[j]]);
+                if (hit >= 0.0 && hit < *t)
+                {
+                    *t = hit;
+                    *offset = mode == SM_PATCH ? 0 : mode == SM_FACE ? tile.face : PICK_NONE;
+                    found = true;
+                }
+            }
+        });
+
+    if (mode == SM_EDGE || (mode == SM_PATCH && nFaces() == 0))
+    {
+        for (auto e : visibleEdges)
+            for (uint j = data.edgeIdxs[e]; j < data.edgeIdxs[e+1]; j++)
+            {
+                float distance;
+                float hit = raySegment(ray, vertices[data.edgeData[j].a],
+                                       vertices[data.edgeData[j].b], &distance);
+                float width = PICK_EDGE_MARGIN * ray.pixelAt(hit);
+                if (distance <= width && hit - width < *t)
+                {
+                    *t = hit - width;
+                    *offset = mode == SM_PATCH ? 0 : e;
+                    found = true;
+                }
+            }
     }
     else if (mode == SM_POINT)
     {
-        if (nFaces() > 0)
+        for (auto p : visiblePoints)
         {
-            setUniforms(prog, mvp, WHITE, 0.0);
-            drawCommand(GL_QUADS, visibleFaces, nFaces(), faceIdxs);
+            const QVector3D &point = vertices[data.pointData[p]];
+            float hit = QVector3D::dotProduct(point - ray.origin, ray.direction);
+            float width = 0.5 * POINT_SIZE * ray.pixelAt(hit);
+            if (hit >= 0.0 && (ray.origin + hit * ray.direction - point).length() <= width &&
+                hit - width < *t)
+            {
+                *t = hit - width;
+                *offset = p;
+                found = true;
+            }
         }
+    }
 
-        pointBuffer.bind();
-        glPointSize(POINT_SIZE);
-        for (uint p = 0; p < nPoints(); p++)
+    return found;
+}
+
+
+void DisplayObject::raycastAll(const PickRay &ray, SelectionMode mode, uint *index, uint *offset,
+                               const RegeneratedGeometry &regenerated)
+{
+    // Thicken the ray enough to reach edges and points on the silhouettes
+    float pad = PICK_EDGE_MARGIN * ray.pixelAt(ray.length);
+
+    std::vector<std::pair<float, uint>> candidates;
+    boundingTree.raycast(ray.origin, ray.direction, [&candidates] (uint i, float enter) {
+        candidates.push_back(std::make_pair(enter, i));
+    }, pad);
+    std::sort(candidates.begin(), candidates.end());
+
+    float t = ray.length;
+    *index = PICK_NONE;
+    *offset = PICK_NONE;
+    for (auto &c : candidates)
+    {
+        if (c.first - pad > t)
+            break;
+        if (indexMap.find(c.second)->second->raycast(ray, mode, &t, offset, regenerated))
+            *index = c.second;
+    }
+
+    if (*offset == PICK_NONE)
+        *index = PICK_NONE;
+}
+
+
+void DisplayObject::xray(const Frustum &frustum, SelectionMode mode, bool inside, ComponentSet *offsets)
+{
+    if (inside)
+    {
+        if (mode == SM_PATCH && !isInvisible(false))
+            offsets->insert(0);
+        else if (mode == SM_FACE)
+            offsets->unite(visibleFaces);
+        else if (mode == SM_EDGE)
+            offsets->unite(visibleEdges);
+        else if (mode == SM_POINT)
+            offsets->unite(visiblePoints);
+        return;
+    }
+
+    // Released geometry is regenerated for this call only
+    Tessellation regenerated;
+    if (_geometryReleased)
+        regenerationJob()(regenerated);
+    const Tessellation &data = _geometryReleased ? regenerated : geometry;
+    if (data.vertexData.empty())
+        return;
+
+    const std::vector<QVector3D> &vertices = data.vertexData;
+    const std::vector<GLuint> &strips = data.faceData;
+    auto stripReaches = [&frustum, &vertices, &strips] (uint begin, uint end) {
+        for (uint j = begin + 2; j < end; j++)
         {
-            if (visiblePoints.find(p) != visiblePoints.end())
-                for (auto off : pointOffsets)
+            if (strips[j] == PRIMITIVE_RESTART)
+            {
+                j += 2;
+                continue;
+            }
+            if (strips[j-1] != PRIMITIVE_RESTART && strips[j-2] != PRIMITIVE_RESTART &&
+                frustum.intersects(vertices[strips[j-2]], vertices[strips[j-1]], vertices[strips[j]]))
+                return true;
+        }
+        return false;
+    };
+
+    if (mode == SM_FACE || (mode == SM_PATCH && nFaces() > 0))
+    {
+        tileTree.query(frustum, [&] (uint i, bool tileInside) {
+            const Tile &tile = data.tiles[i];
+            uint offset = mode == SM_PATCH ? 0 : tile.face;
+            if (!visibleFaces.contains(tile.face) || offsets->contains(offset))
+                return;
+
+            if (tileInside || stripReaches(tile.faceBegin, tile.faceEnd))
+                offsets->insert(offset);
+        });
+        if (mode == SM_FACE || !offsets->empty())
+            return;
+    }
+
+    if (mode == SM_EDGE || mode == SM_PATCH)
+    {
+        for (auto e : visibleEdges)
+            for (uint j = data.edgeIdxs[e]; j < data.edgeIdxs[e+1]; j++)
+                if (frustum.intersects(vertices[data.edgeData[j].a], vertices[data.edgeData[j].b]))
                 {
-                    setUniforms(prog, mvp, indexToColor(_index, offset), off);
-                    drawCommandPts({p}, nPoints());
+                    offsets->insert(mode == SM_PATCH ? 0 : e);
+                    break;
                 }
-            offset++;
-        }
     }
+    else if (mode == SM_POINT)
+    {
+        for (auto p : visiblePoints)
+            if (frustum.classify(vertices[data.pointData[p]], 0.0) != CT_OUTSIDE)
+                offsets->insert(p);
+    }
+}
+
+
+void DisplayObject::regenerationJobs(const Frustum &frustum,
+                                     std::vector<std::pair<uint, std::function<void(Tessellation &)>>> *jobs)
+{
+    cull(frustum, [jobs] (DisplayObject *obj, bool) {
+        auto job = obj->regenerationJob();
+        if (job)
+            jobs->push_back(std::make_pair(obj->_index, job));
+    });
+}
+
+
+void DisplayObject::xrayAll(const Frustum &frustum, SelectionMode mode, std::set<std::pair<uint,uint>> *picks)
+{
+    cull(frustum, [&frustum, mode, picks] (DisplayObject *obj, bool inside) {
+        ComponentSet offsets;
+        obj->xray(frustum, mode, inside, &offsets);
+        for (auto o : offsets)
+            picks->insert(std::make_pair(obj->_index, o));
+    });
 }
 
 
 void DisplayObject::computeBoundingSphere()
 {
-    QVector3D point = vertexData[0], found;
+    QVector3D point = geometry.vertexData[0], found;
 
     farthestPointFrom(point, &found);
     farthestPointFrom(point, &found);
@@ -339,7 +1190,7 @@ void DisplayObject::farthestPointFrom(QVector3D point, QVector3D *found)
 {
     float distance = -1;
 
-    for (auto p : vertexData)
+    for (auto p : geometry.vertexData)
     {
         float _distance = (p - point).length();
         if (_distance > distance)
@@ -353,7 +1204,7 @@ void DisplayObject::farthestPointFrom(QVector3D point, QVector3D *found)
 
 void DisplayObject::ritterSphere()
 {
-    for (auto p : vertexData)
+    for (auto p : geometry.vertexData)
     {
         float d = (p - _center).length();
         if (d > _radius)
@@ -365,19 +1216,10 @@ void DisplayObject::ritterSphere()
 }
 
 
-void DisplayObject::mkSamples(const std::vector<double> &knots, std::vector<double> &params, uint ref)
-{
-    params.resize((knots.size() - 1) * ref + 1);
-
-    for (uint i = 0; i < knots.size() - 1; i++)
-        for (uint j = 0; j < ref; j++)
-            params[i*ref + j] = knots[i] + (double) j / ref * (knots[i+1] - knots[i]);
-    params.back() = knots.back();
-}
-
-
 void DisplayObject::selectionMode(SelectionMode mode, bool conjunction)
 {
+    pendingFlags.insert(_index);
+
     switch (mode)
     {
     case SM_PATCH:
@@ -409,31 +1251,35 @@ void DisplayObject::selectionMode(SelectionMode mode, bool conjunction)
 
 void DisplayObject::selectObject(SelectionMode mode, bool selected)
 {
+    pendingFlags.insert(_index);
+
     if (selected)
     {
         if (mode == SM_FACE || mode == SM_PATCH)
         {
             if (nFaces() > 0)
             {
-                for (int i = 0; i < nFaces(); i++)
-                    selectedFaces.insert(i);
+                selectedFaces.resize(nFaces());
+                selectedFaces.fill();
                 refreshEdgesFromFaces();
             }
             else
-                for (int i = 0; i < nEdges(); i++)
-                    selectedEdges.insert(i);
+            {
+                selectedEdges.resize(nEdges());
+                selectedEdges.fill();
+            }
             refreshPointsFromEdges();
         }
         else if (mode == SM_EDGE)
         {
-            for (int i = 0; i < nEdges(); i++)
-                selectedEdges.insert(i);
+            selectedEdges.resize(nEdges());
+            selectedEdges.fill();
             refreshPointsFromEdges();
         }
         else if (mode == SM_POINT)
         {
-            for (int i = 0; i < nPoints(); i++)
-                selectedPoints.insert(i);
+            selectedPoints.resize(nPoints());
+            selectedPoints.fill();
         }
     }
     else
@@ -445,64 +1291,52 @@ void DisplayObject::selectObject(SelectionMode mode, bool selected)
 }
 
 
-void DisplayObject::selectFaces(bool selected, std::set<uint> faces)
+void DisplayObject::selectFaces(bool selected, const ComponentSet &faces)
 {
+    pendingFlags.insert(_index);
+
     if (!selected)
     {
-        for (auto f : faces)
-            selectedFaces.erase(f);
+        selectedFaces.subtract(faces);
         refreshEdgesFromFaces();
         refreshPointsFromEdges();
 
         return;
     }
 
-    selectedFaces.insert(faces.begin(), faces.end());
-
-    std::set<uint> edges;
-    for (auto f : faces)
-    {
-        edges.insert(faceEdgeMap[f].a);
-        edges.insert(faceEdgeMap[f].b);
-        edges.insert(faceEdgeMap[f].c);
-        edges.insert(faceEdgeMap[f].d);
-    }
+    selectedFaces.unite(faces);
 
+    ComponentSet edges(nEdges());
+    topology().edgesOf(faces, &edges);
     selectEdges(true, edges);
 }
 
 
-void DisplayObject::selectEdges(bool selected, std::set<uint> edges)
+void DisplayObject::selectEdges(bool selected, const ComponentSet &edges)
 {
+    pendingFlags.insert(_index);
+
     if (!selected)
     {
-        for (auto e : edges)
-            selectedEdges.erase(e);
+        selectedEdges.subtract(edges);
         refreshPointsFromEdges();
 
         return;
     }
 
-    selectedEdges.insert(edges.begin(), edges.end());
-
-    std::set<uint> points;
-    for (auto e : edges)
-    {
-        points.insert(edgePointMap[e].a);
-        points.insert(edgePointMap[e].b);
-    }
-
-    selectPoints(true, points);
+    selectedEdges.unite(edges);
+    topology().pointsOf(edges, &selectedPoints);
 }
 
 
-void DisplayObject::selectPoints(bool selected, std::set<uint> points)
+void DisplayObject::selectPoints(bool selected, const ComponentSet &points)
 {
+    pendingFlags.insert(_index);
+
     if (selected)
-        selectedPoints.insert(points.begin(), points.end());
+        selectedPoints.unite(points);
     else
-        for (auto p : points)
-            selectedPoints.erase(p);
+        selectedPoints.subtract(points);
 }
 
 
@@ -511,142 +1345,349 @@ bool DisplayObject::fullSelection(SelectionMode mode)
     if (mode == SM_PATCH)
         return hasSelection();
     else if (mode == SM_FACE)
-        return selectedFaces.size() == nFaces();
+        return selectedFaces.count() == nFaces();
     else if (mode == SM_EDGE)
-        return selectedEdges.size() == nEdges();
+        return selectedEdges.count() == nEdges();
     else if (mode == SM_POINT)
-        return selectedPoints.size() == nPoints();
+        return selectedPoints.count() == nPoints();
 }
 
 
 void DisplayObject::showSelected(SelectionMode mode, bool visible)
 {
+    pendingFlags.insert(_index);
+
     if (mode == SM_PATCH)
     {
         if (!visible)
         {
-            visibleFaces = {};
-            visibleEdges = {};
-            visiblePoints = {};
+            visibleFaces.clear();
+            visibleEdges.clear();
+            visiblePoints.clear();
         }
         else
         {
-            for (int i = 0; i < nFaces(); i++)
-                visibleFaces.insert(i);
-            for (int i = 0; i < nEdges(); i++)
-                visibleEdges.insert(i);
-            for (int i = 0; i < nPoints(); i++)
-                visiblePoints.insert(i);
+            visibleFaces.resize(nFaces());
+            visibleEdges.resize(nEdges());
+            visiblePoints.resize(nPoints());
+            visibleFaces.fill();
+            visibleEdges.fill();
+            visiblePoints.fill();
         }
     }
     else if (mode == SM_FACE)
     {
         if (!visible)
-            for (auto f : selectedFaces)
-                visibleFaces.erase(f);
+            visibleFaces.subtract(selectedFaces);
         else
-            visibleFaces.insert(selectedFaces.begin(), selectedFaces.end());
+            visibleFaces.unite(selectedFaces);
     }
     else if (mode == SM_EDGE)
     {
         if (!visible)
-            for (auto f : selectedEdges)
-                visibleEdges.erase(f);
+            visibleEdges.subtract(selectedEdges);
         else
-            visibleEdges.insert(selectedEdges.begin(), selectedEdges.end());
+            visibleEdges.unite(selectedEdges);
     }
     else if (mode == SM_POINT)
     {
         if (!visible)
-            for (auto f : selectedPoints)
-                visiblePoints.erase(f);
+            visiblePoints.subtract(selectedPoints);
         else
-            visiblePoints.insert(selectedPoints.begin(), selectedPoints.end());
+            visiblePoints.unite(selectedPoints);
     }
+
+    updateLeaf();
 }
 
 
 void DisplayObject::refreshEdgesFromFaces()
 {
     selectedEdges.clear();
-    for (auto e : selectedFaces)
-        selectEdges(true, {faceEdgeMap[e].a, faceEdgeMap[e].b, faceEdgeMap[e].c, faceEdgeMap[e].d});
+    topology().edgesOf(selectedFaces, &selectedEdges);
+    topology().pointsOf(selectedEdges, &selectedPoints);
 }
 
 
 void DisplayObject::refreshPointsFromEdges()
 {
     selectedPoints.clear();
-    for (auto e : selectedEdges)
-        selectPoints(true, {edgePointMap[e].a, edgePointMap[e].b});
+    topology().pointsOf(selectedEdges, &selectedPoints);
 }
 
 
 void DisplayObject::balloonEdgesToFaces(bool conjunction)
 {
-    std::set<uint> faces;
-    for (uint f = 0; f < nFaces(); f++)
-        if ((conjunction &&  (selectedEdges.find(faceEdgeMap[f].a) != selectedEdges.end() &&
-                              selectedEdges.find(faceEdgeMap[f].b) != selectedEdges.end() &&
-                              selectedEdges.find(faceEdgeMap[f].c) != selectedEdges.end() &&
-                              selectedEdges.find(faceEdgeMap[f].d) != selectedEdges.end())) ||
-            (!conjunction && (selectedEdges.find(faceEdgeMap[f].a) != selectedEdges.end() ||
-                              selectedEdges.find(faceEdgeMap[f].b) != selectedEdges.end() ||
-                              selectedEdges.find(faceEdgeMap[f].c) != selectedEdges.end() ||
-                              selectedEdges.find(faceEdgeMap[f].d) != selectedEdges.end())))
-        {
-            faces.insert(f);
-        }
-
+    ComponentSet faces(nFaces());
+    topology().facesWith(selectedEdges, conjunction, &faces);
     selectFaces(true, faces);
 }
 
 
 void DisplayObject::balloonPointsToEdges(bool conjunction)
 {
-    std::set<uint> edges;
-    for (uint e = 0; e < nEdges(); e++)
-        if ((conjunction &&  (selectedPoints.find(edgePointMap[e].a) != selectedPoints.end() &&
-                              selectedPoints.find(edgePointMap[e].b) != selectedPoints.end())) ||
-            (!conjunction && (selectedPoints.find(edgePointMap[e].a) != selectedPoints.end() ||
-                              selectedPoints.find(edgePointMap[e].b) != selectedPoints.end())))
+    ComponentSet edges(nEdges());
+    topology().edgesWith(selectedPoints, conjunction, &edges);
+    selectEdges(true, edges);
+}
+
+
+void DisplayObject::writeFlags()
+{
+    // Faces, then edges, then points, as the shader expects
+    std::vector<GLubyte> &flags = flagData;
+    flags.assign(std::max(nFaces() + nEdges() + nPoints(), 1u), 0);
+    uint edges = nFaces(), points = nFaces() + nEdges();
+
+    for (auto i : visibleFaces)
+        flags[i] |= COMPONENT_VISIBLE;
+    for (auto i : selectedFaces)
+        flags[i] |= COMPONENT_SELECTED;
+    for (auto i : visibleEdges)
+        flags[edges + i] |= COMPONENT_VISIBLE;
+    for (auto i : selectedEdges)
+        flags[edges + i] |= COMPONENT_SELECTED;
+    for (auto i : visiblePoints)
+        flags[points + i] |= COMPONENT_VISIBLE;
+    for (auto i : selectedPoints)
+        flags[points + i] |= COMPONENT_SELECTED;
+
+    flagArena.write(flagBlock, &flags[0], flags.size());
+}
+
+
+void DisplayObject::freeBlocks()
+{
+    vertexArena[_bufferCompact ? 1 : 0].free(vertexBlock);
+    indexArena.free(indexBlock);
+    rangeArena.free(rangeBlock);
+    flagArena.free(flagBlock);
+}
+
+
+bool DisplayObject::linkProgram(QOpenGLShaderProgram &prog, bool picking, bool lines)
+{
+    prog.bindAttributeLocation("vertexPosition", ATTRIBUTE_POSITION);
+    prog.bindAttributeLocation("vertexNormal", ATTRIBUTE_NORMAL);
+    if (!prog.link())
+        return false;
+
+    QOpenGLFunctions_3_2_Core *gl = functions();
+    GLuint block = gl->glGetUniformBlockIndex(prog.programId(), "Camera");
+    if (block == GL_INVALID_INDEX)
+        return false;
+    gl->glUniformBlockBinding(prog.programId(), block, CAMERA_BINDING);
+
+    Locations &loc = locations[programIndex(picking, lines)];
+    loc.prog = &prog;
+    loc.picking = picking;
+    loc.col = prog.uniformLocation("col");
+    loc.colSelected = prog.uniformLocation("colSelected");
+    loc.p = prog.uniformLocation("p");
+    loc.compact = prog.uniformLocation("compact");
+    loc.quantBoxes = prog.uniformLocation("quantBoxes");
+    loc.id = prog.uniformLocation("id");
+    loc.lookup = prog.uniformLocation("lookup");
+    loc.primitiveBase = prog.uniformLocation("primitiveBase");
+    loc.rangeStart = prog.uniformLocation("rangeStart");
+    loc.rangeCount = prog.uniformLocation("rangeCount");
+    loc.ranges = prog.uniformLocation("ranges");
+    loc.flags = prog.uniformLocation("flags");
+    loc.objects = prog.uniformLocation("objects");
+    loc.pages = prog.uniformLocation("pages");
+    loc.lineWidth = prog.uniformLocation("lineWidth");
+
+    prog.bind();
+    prog.setUniformValue(loc.quantBoxes, (GLint) 0);
+    prog.setUniformValue(loc.ranges, (GLint) 1);
+    prog.setUniformValue(loc.flags, (GLint) 2);
+    prog.setUniformValue(loc.objects, (GLint) 3);
+    prog.setUniformValue(loc.pages, (GLint) 4);
+
+    return true;
+}
+
+
+void DisplayObject::bindArena(QOpenGLShaderProgram &prog)
+{
+    QOpenGLFunctions_3_2_Core *gl = functions();
+    uint format = _compact ? 1 : 0;
+    GeometryArena &vertices = vertexArena[format];
+
+    // Make sure the buffers exist, even if nothing has been allocated. This binds the index
+    // arena, so it must happen before the vertex array object is bound.
+    vertices.reserve(1);
+    indexArena.reserve(1);
+    if (_compact)
+        quantArena.reserve(4 * sizeof(GLfloat));
+    bool picking = locationsOf(prog).picking;
+    pageArena[format].reserve(sizeof(GLuint));
+    rangeArena.reserve(sizeof(GLuint));
+    objectArena.reserve(4 * sizeof(GLuint));
+    if (!picking)
+        flagArena.reserve(sizeof(GLubyte));
+
+    prog.bind();
+
+    if (!arenaArrays[format])
+    {
+        gl->glGenVertexArrays(1, &arenaArrays[format]);
+        arrayGenerations[format] = std::make_pair(0, 0);
+    }
+    gl->glBindVertexArray(arenaArrays[format]);
+
+    // The attribute pointers and the index buffer are vertex array state, so they only need to be
+    // set again when an arena has grown into a new buffer
+    auto generations = std::make_pair(vertices.generation(), indexArena.generation());
+    if (arrayGenerations[format] != generations)
+    {
+        gl->glBindBuffer(GL_ARRAY_BUFFER, vertices.buffer().bufferId());
+        gl->glEnableVertexAttribArray(ATTRIBUTE_POSITION);
+        gl->glEnableVertexAttribArray(ATTRIBUTE_NORMAL);
+        if (_compact)
+        {
+            // Positions arrive normalized in [0,1] and normals in [-1,1]
+            gl->glVertexAttribPointer(ATTRIBUTE_POSITION, 3, GL_UNSIGNED_SHORT, GL_TRUE,
+                                      sizeof(packedVertex), (const GLvoid *) 0);
+            gl->glVertexAttribPointer(ATTRIBUTE_NORMAL, 2, GL_BYTE, GL_TRUE, sizeof(packedVertex),
+                                      (const GLvoid *) (3 * sizeof(GLushort)));
+        }
+        else
         {
-            edges.insert(e);
+            gl->glVertexAttribPointer(ATTRIBUTE_POSITION, 3, GL_FLOAT, GL_FALSE, sizeof(fullVertex),
+                                      (const GLvoid *) 0);
+            gl->glVertexAttribPointer(ATTRIBUTE_NORMAL, 3, GL_FLOAT, GL_FALSE, sizeof(fullVertex),
+                                      (const GLvoid *) (3 * sizeof(GLfloat)));
         }
+        gl->glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexArena.buffer().bufferId());
+        arrayGenerations[format] = generations;
+    }
 
-    selectEdges(true, edges);
+    if (_compact)
+    {
+        if (!quantTexture)
+            glGenTextures(1, &quantTexture);
+        gl->glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_BUFFER, quantTexture);
+        if (quantGeneration != quantArena.generation())
+        {
+            gl->glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, quantArena.buffer().bufferId());
+            quantGeneration = quantArena.generation();
+        }
+    }
+
+    if (!rangeTexture)
+        glGenTextures(1, &rangeTexture);
+    gl->glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_BUFFER, rangeTexture);
+    if (rangeGeneration != rangeArena.generation())
+    {
+        gl->glTexBuffer(GL_TEXTURE_BUFFER, GL_R32UI, rangeArena.buffer().bufferId());
+        rangeGeneration = rangeArena.generation();
+    }
+
+    if (!picking)
+    {
+        if (!flagTexture)
+            glGenTextures(1, &flagTexture);
+        gl->glActiveTexture(GL_TEXTURE2);
+        glBindTexture(GL_TEXTURE_BUFFER, flagTexture);
+        if (flagGeneration != flagArena.generation())
+        {
+            gl->glTexBuffer(GL_TEXTURE_BUFFER, GL_R8UI, flagArena.buffer().bufferId());
+            flagGeneration = flagArena.generation();
+        }
+    }
+
+    // Both programs find the object and face of each vertex from these
+    if (!objectTexture)
+        glGenTextures(1, &objectTexture);
+    gl->glActiveTexture(GL_TEXTURE3);
+    glBindTexture(GL_TEXTURE_BUFFER, objectTexture);
+    if (objectGeneration != objectArena.generation())
+    {
+        gl->glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32UI, objectArena.buffer().bufferId());
+        objectGeneration = objectArena.generation();
+    }
+
+    if (!pageTextures[format])
+        glGenTextures(1, &pageTextures[format]);
+    gl->glActiveTexture(GL_TEXTURE4);
+    glBindTexture(GL_TEXTURE_BUFFER, pageTextures[format]);
+    if (pageGenerations[format] != pageArena[format].generation())
+    {
+        gl->glTexBuffer(GL_TEXTURE_BUFFER, GL_R32UI, pageArena[format].buffer().bufferId());
+        pageGenerations[format] = pageArena[format].generation();
+    }
+    gl->glActiveTexture(GL_TEXTURE0);
+
+    // The line programs share the arena with the program they go with
+    for (const Locations &loc : locations)
+    {
+        if (!loc.prog)
+            continue;
+        loc.prog->bind();
+        loc.prog->setUniformValue(loc.compact, (GLint) _compact);
+    }
+    prog.bind();
+}
+
+
+void DisplayObject::setUniforms(QOpenGLShaderProgram &prog, QVector3D col, float p)
+{
+    const Locations &loc = locationsOf(prog);
+    prog.setUniformValue(loc.col, col);
+    prog.setUniformValue(loc.p, p);
 }
 
 
-void DisplayObject::createBuffer(QOpenGLBuffer &buffer)
+void DisplayObject::setColors(QOpenGLShaderProgram &prog, ColorLookup lookup, QVector3D col,
+                              QVector3D colSelected)
 {
-    buffer.create();
-    buffer.setUsagePattern(QOpenGLBuffer::StaticDraw);
-    buffer.bind();
+    const Locations &loc = locationsOf(prog);
+    prog.setUniformValue(loc.lookup, (GLint) lookup);
+    prog.setUniformValue(loc.col, col);
+    prog.setUniformValue(loc.colSelected, colSelected);
 }
 
 
-void DisplayObject::bindBuffer(QOpenGLShaderProgram &prog, QOpenGLBuffer &buffer, const char *attribute)
+void DisplayObject::setPickUniforms(QOpenGLShaderProgram &prog, uint index, uint offset, float p)
 {
-    buffer.bind();
-    prog.enableAttributeArray(attribute);
-    prog.setAttributeBuffer(attribute, GL_FLOAT, 0, 3);
+    const Locations &loc = locationsOf(prog);
+    functions()->glUniform2ui(loc.id, index, offset);
+    prog.setUniformValue(loc.p, p);
 }
 
 
-void DisplayObject::setUniforms(QOpenGLShaderProgram &prog, QMatrix4x4 mvp, QVector3D col, float p)
+void DisplayObject::setPickLookup(QOpenGLShaderProgram &prog, PickLookup lookup, uint start, uint count)
 {
-    prog.setUniformValue("mvp", mvp);
-    prog.setUniformValue("col", col);
-    prog.setUniformValue("p", p);
+    const Locations &loc = locationsOf(prog);
+    prog.setUniformValue(loc.lookup, (GLint) lookup);
+    prog.setUniformValue(loc.rangeStart, (GLint) start);
+    prog.setUniformValue(loc.rangeCount, (GLint) count);
 }
 
 
-void DisplayObject::setUniforms(QOpenGLShaderProgram &prog, QMatrix4x4 mvp, uchar *col, float p)
+void DisplayObject::setLineWidth(QOpenGLShaderProgram &prog, float width)
 {
-    prog.setUniformValue("mvp", mvp);
-    prog.setUniformValue("col", QVector3D((float) col[0]/255, (float) col[1]/255, (float) col[2]/255));
-    prog.setUniformValue("p", p);
+    prog.setUniformValue(locationsOf(prog).lineWidth, width);
+}
+
+
+DisplayObject::Locations &DisplayObject::locationsOf(const QOpenGLShaderProgram &prog)
+{
+    for (Locations &loc : locations)
+        if (loc.prog == &prog)
+            return loc;
+    return locations[0];
+}
+
+
+QOpenGLShaderProgram &DisplayObject::bindLines(const QOpenGLShaderProgram &prog)
+{
+    QOpenGLShaderProgram *lines = locations[programIndex(locationsOf(prog).picking, true)].prog;
+    lines->bind();
+    return *lines;
 }
 
 
@@ -658,48 +1699,56 @@ DisplayObject *DisplayObject::getObject(uint idx)
 }
 
 
-uint DisplayObject::registerObject(DisplayObject *obj)
+void DisplayObject::setCompact(bool compact)
 {
-    while (indexMap.find(nextIndex) != indexMap.end())
-        nextIndex = (nextIndex + 1) % NUM_INDICES;
+    _compact = compact;
 
-    indexMap[nextIndex] = obj;
-    return nextIndex;
+    for (auto i : indexMap)
+        if (i.second->_initialized)
+            pendingUploads.insert(i.first);
 }
 
 
-void DisplayObject::deregisterObject(uint index)
+void DisplayObject::setOcclusionCulling(bool occlusionCulling)
 {
-    indexMap.erase(index);
+    _occlusionCulling = occlusionCulling;
 }
 
 
-QVector3D DisplayObject::indexToColor(uint index, uint offset)
+void DisplayObject::setLowMemory(bool lowMemory)
 {
-    uint i = COLORS_PER_OBJECT * index + offset;
-
-    uchar red = i % 256; i /= 256;
-    uchar green = i % 256; i /= 256;
-    uchar blue = i % 256;
+    _lowMemory = lowMemory;
 
-    return QVector3D((float) red/255, (float) green/255, (float) blue/255);
+    if (_lowMemory)
+        for (auto i : indexMap)
+            if (i.second->_initialized && !i.second->_geometryReleased)
+                i.second->releaseGeometry();
 }
 
 
-void DisplayObject::colorToIndex(GLubyte color[3], uint *index, uint *offset)
+void DisplayObject::uploadPending()
 {
-    keyToIndex(colorToKey(color), index, offset);
+    for (auto idx : pendingUploads)
+        if (indexMap.find(idx) != indexMap.end())
+            indexMap[idx]->initialize();
+    pendingUploads.clear();
 }
 
 
-uint DisplayObject::colorToKey(GLubyte color[3])
+uint DisplayObject::registerObject(DisplayObject *obj)
 {
-    return color[2]*256*256 + color[1]*256 + color[0];
+    while (indexMap.find(nextIndex) != indexMap.end())
+        nextIndex = (nextIndex + 1) % PICK_NONE;
+
+    indexMap[nextIndex] = obj;
+    return nextIndex;
 }
 
 
-void DisplayObject::keyToIndex(uint key, uint *index, uint *offset)
+void DisplayObject::deregisterObject(uint index)
 {
-    *index = key / COLORS_PER_OBJECT;
-    *offset = key % COLORS_PER_OBJECT;
+    indexMap.erase(index);
+
+    // Reuse the freed index, so that the tables indexed by object stay small
+    nextIndex = std::min(nextIndex, index);
 }
@@ -40,33 +40,168 @@
 
 #include <vector>
 #include <set>
+#include <functional>
+#include <memory>
 #include <map>
-#include <mutex>
-#include <unordered_map>
 
 #include <QOpenGLBuffer>
 #include <QOpenGLShaderProgram>
 #include <QMatrix4x4>
 #include <QVector3D>
 
+#include "BoundingTree.h"
+#include "ComponentSet.h"
+#include "Frustum.h"
+#include "GeometryArena.h"
+#include "SharedMutex.h"
+#include "Topology.h"
+
 #ifndef _DISPLAYOBJECT_H_
 #define _DISPLAYOBJECT_H_
 
-#define NUM_COLORS 16777216
-#define COLORS_PER_OBJECT 12
-#define NUM_INDICES (NUM_COLORS/COLORS_PER_OBJECT)
-#define WHITE_KEY (NUM_COLORS-1)
+//! The object index written to the picking buffer where no selectable component is drawn.
+#define PICK_NONE 0xFFFFFFFF
+
+//! The distance in pixels within which a ray hits an edge (see DisplayObject::raycast()).
+#define PICK_EDGE_MARGIN 20.0
+
+//! Bits of the component flags read by the object shader program (see DisplayObject::flagArena).
+#define COMPONENT_VISIBLE 1
+#define COMPONENT_SELECTED 2
+
+//! The index terminating a triangle strip in Tessellation::faceData.
+#define PRIMITIVE_RESTART 0xFFFFFFFF
+
+//! Attribute locations of the object shader program (see DisplayObject::linkProgram()).
+#define ATTRIBUTE_POSITION 0
+#define ATTRIBUTE_NORMAL 1
+
+//! \brief The number of vertices in a page of the vertex arenas. Vertex blocks start on a page,
+//! so that the shaders can find the object of a vertex from its page (see
+//! DisplayObject::pageArena). Must match the object vertex shader.
+#define VERTEX_PAGE 64
+
+//! The uniform buffer binding point of the Camera block.
+#define CAMERA_BINDING 0
+
+//! How the picking program finds the component of a fragment (see DisplayObject::drawPicking()).
+enum PickLookup {
+    PL_CONSTANT, //!< The component is given as a uniform.
+    PL_RANGES,   //!< The component is found from the primitive in a table of ranges.
+    PL_DIRECT,   //!< The component is the primitive.
+    PL_FACE      //!< The component is the face of the provoking vertex (see Tessellation::faceData).
+};
+
+//! Which components the object program colors from their flags (see DisplayObject::drawAll()).
+enum ColorLookup {
+    CL_CONSTANT, //!< The color is given as a uniform.
+    CL_FACES,    //!< Faces and element lines, colored by the face of the provoking vertex.
+    CL_EDGES,    //!< Edges, found from the primitive in the table of line bounds.
+    CL_POINTS    //!< Points, where the component is the primitive.
+};
 
 typedef unsigned char uchar;
 typedef unsigned short ushort;
 typedef unsigned int uint;
-typedef struct { GLuint a, b, c, d; } quad;
 typedef struct { GLuint a, b; } pair;
-enum ObjectType { OT_VOLUME, OT_SURFACE, OT_CURVE };
+typedef struct { GLfloat x, y, z, nx, ny, nz; } fullVertex;
+typedef struct { GLushort x, y, z; GLbyte nx, ny; } packedVertex;
 enum SelectionMode { SM_PATCH, SM_FACE, SM_EDGE, SM_POINT };
 
 class Patch;
 
+//! \brief A rectangular block of knot spans on one face of a DisplayObject.
+//!
+//! Large faces are split into tiles, so that culling, level of detail and partial updates can work
+//! below the granularity of whole faces. Each tile has its own bounding sphere and ranges in
+//! Tessellation::faceData and Tessellation::elementData.
+struct Tile
+{
+    uint face;                     //!< The face this tile belongs to.
+    uint faceBegin, faceEnd;       //!< Range of indices in Tessellation::faceData.
+    uint elementBegin, elementEnd; //!< Range of lines in Tessellation::elementData.
+    QVector3D center;              //!< Center of the bounding sphere.
+    float radius;                  //!< Radius of the bounding sphere.
+};
+
+
+//! \brief A ray through a pixel, for picking on the CPU (see DisplayObject::raycastAll()).
+struct PickRay
+{
+    QVector3D origin;    //!< The point on the near plane.
+    QVector3D direction; //!< Unit direction towards the far plane.
+    float length;        //!< Distance from the near plane to the far plane.
+    float pixel;         //!< The width of a pixel at the origin.
+    float pixelGrowth;   //!< The growth of the pixel width per unit distance along the ray.
+
+    //! Returns the width of a pixel at the given ray parameter.
+    inline float pixelAt(float t) const { return pixel + pixelGrowth * t; }
+};
+
+
+//! \brief The geometry of a DisplayObject at a given tessellation quality.
+//!
+//! This is everything needed to fill the OpenGL buffers. It depends only on the underlying
+//! patch and the quality, so it can be computed on any thread (see DisplayObject::tessellationJob()).
+struct Tessellation
+{
+    //! The vertices of this object. The order is not important (for the superclass).
+    std::vector<QVector3D> vertexData;
+
+    //! The outward-facing normals (if applicable). The indexing must correspond to #vertexData.
+    std::vector<QVector3D> normalData;
+
+    //! \brief Indices of the triangle strips to draw, each terminated by #PRIMITIVE_RESTART.
+    //! Indices must correspond to #vertexData.
+    //!
+    //! The shaders find the face of a triangle from its vertices, so the vertices used by each
+    //! face must be a contiguous range of #vertexData, which no other face uses. Faces that meet
+    //! need separate copies of the vertices there.
+    std::vector<GLuint> faceData;
+
+    //! \brief A pair of indices for each element line to draw. These are the thin blue lines
+    //! inside faces. Indices must correspond to #vertexData, and be vertices of the face the
+    //! line lies in (see #faceData).
+    std::vector<pair> elementData;
+
+    //! \brief A pair of indices for each edge to draw. These are the thick black lines denoting
+    //! the actual topological edges. Indices must correspond to #vertexData.
+    std::vector<pair> edgeData;
+
+    //! \brief An index for each vertex to draw. These are drawn as black circles.
+    //! Indices must correspond to #vertexData.
+    std::vector<GLuint> pointData;
+
+    //! \brief Index bounds for faces.
+    //!
+    //! Should be of size DisplayObject::nFaces()+1. E.g. if the first 20 entries in #faceData make
+    //! up the first face, and the second 40 make up the second face, then #faceIdxs should be
+    //! {0,20,60}. Used by DisplayObject::draw() to find the right indices when not all faces are
+    //! visible.
+    std::vector<uint> faceIdxs;
+
+    //! \brief Index bounds for elements. Works like #faceIdxs, but for #elementData.
+    std::vector<uint> elementIdxs;
+
+    //! \brief Index bounds for edges. Works like #faceIdxs, but for #edgeData.
+    std::vector<uint> edgeIdxs;
+
+    //! \brief The tiles of all faces, ordered by face.
+    //!
+    //! The tiles of a face partition its ranges in #faceData and #elementData, as given by
+    //! #faceIdxs and #elementIdxs. May be empty, e.g. for objects without faces.
+    std::vector<Tile> tiles;
+
+    //! The quality this tessellation was computed at (see DisplayObject::tessellationJob()).
+    float quality;
+};
+
+
+//! \brief Tessellations regenerated for a query, by object index, for objects whose geometry has
+//! been released in low memory mode (see DisplayObject::regenerationJobs()).
+typedef std::map<uint, Tessellation> RegeneratedGeometry;
+
+
 //! \brief This is a superclass for all drawable objects (patches).
 //!
 //! A DisplayObject should always be owned by a Patch object (see ObjectSet for details).
@@ -78,8 +213,8 @@ class Patch;
 //! and visibility of subcomponents (by which we mean faces, edges and vertices). See
 //! \ref DisplayObjectComponents for more.
 //!
-//! To subclass DisplayObject, you must implement type(), nFaces(), nEdges() and
-//! nPoints(). In addition, the constructor must initialize a number of protected members.
+//! To subclass DisplayObject, you must implement type(), nFaces(), nEdges(), nPoints() and
+//! tessellationJob(). In addition, the constructor must initialize a number of protected members.
 //! These are described in \ref DisplayObjectSubclassing.
 class DisplayObject
 {
@@ -89,7 +224,7 @@ public:
     DisplayObject();
 
     //! \brief Frees the index held by this object by calling deregisterObject(), and then
-    //! destroys the allocated OpenGL buffers if initialized.
+    //! frees its blocks in the arenas if initialized.
     //! DisplayObject::m should be locked before calling.
     virtual ~DisplayObject();
 
@@ -101,32 +236,117 @@ public:
 
     //! \brief Initialize this object. The caller must ensure that the OpenGL context is current.
     //!
-    //! This will create the OpenGL buffers (#vertexBuffer, #normalBuffer, #faceBuffer,
-    //! #elementBuffer, #edgeBuffer and #pointBuffer).
+    //! This will allocate and fill blocks in the shared arenas (#vertexArena and #indexArena),
+    //! replacing any old blocks of this object. If a pending tessellation has been set with
+    //! setTessellation(), it replaces the current one and the buffers are refilled, also if the
+    //! object was already initialized. The same happens if the buffer format has changed (see
+    //! setCompact()). In low memory mode, the CPU-side geometry is released afterwards (see
+    //! setLowMemory()). DisplayObject::m should be locked before calling.
     void initialize();
 
-    //! \brief Draws this object to the OpenGL buffer. The caller must ensure that the OpenGL
-    //! context is current.
+    //! \brief Makes sure the CPU-side geometry (#geometry) is available.
     //!
-    //! \param mvp The model-view-projection matrix to transform augmented 4-vectors from
-    //! model space to the OpenGL drawable surface.
-    //! \param prog The OpenGL shader program to use.
-    //! \param showPoints Whether to draw the vertices or not.
-    void draw(QMatrix4x4 &mvp, QOpenGLShaderProgram &prog, bool showPoints);
+    //! If it was released after uploading in low memory mode, it is regenerated from the spline
+    //! at the quality of the uploaded tessellation. This may be slow. DisplayObject::m should be
+    //! locked before calling.
+    void ensureGeometry();
+
+    //! \brief Returns a job that regenerates the geometry released in low memory mode, at the
+    //! quality of the uploaded tessellation, or an empty function if it has not been released.
+    //!
+    //! Queries use the result in place of #geometry, and drop it afterwards, so that low memory
+    //! mode stays in effect. Like tessellationJob(), the job can run without any locks held.
+    //! DisplayObject::m should be locked, at least shared, before calling.
+    std::function<void(Tessellation &)> regenerationJob();
+
+    //! Returns the current tessellation quality (see tessellationJob()).
+    inline float quality() { return _quality; }
+
+    //! \brief Returns a job that computes the tessellation of this object at a given quality.
+    //!
+    //! The quality scales the number of samples in each element, with 1.0 being the default.
+    //! The job must not refer to the DisplayObject itself, since it may run on a worker thread
+    //! without any locks held, and possibly after the object has been destroyed.
+    virtual std::function<void(Tessellation &)> tessellationJob(float quality) = 0;
+
+    //! \brief Starts a new re-tessellation of this object.
+    //!
+    //! Any earlier request that hasn't been delivered yet is invalidated.
+    //! DisplayObject::m should be locked before calling.
+    //!
+    //! \param quality The new quality.
+    //! \retval request A globally unique identifier for this request, to pass to setTessellation().
+    //! \return The job to run (see tessellationJob()).
+    std::function<void(Tessellation &)> requestTessellation(float quality, uint *request);
+
+    //! Check whether a request from requestTessellation() is still current.
+    //! DisplayObject::m should be locked before calling.
+    inline bool tessellationCurrent(uint request) { return request == _request; }
+
+    //! \brief Delivers the result of a request from requestTessellation().
+    //!
+    //! If the request is current, this object takes ownership of the data, and its index is added
+    //! to #pendingUploads. The arenas are not touched until the next call to initialize(),
+    //! so the old geometry can be drawn in the meantime. Otherwise nothing happens.
+    //! DisplayObject::m should be locked before calling.
+    //!
+    //! \return True if the data was accepted. If not, the caller still owns it.
+    bool setTessellation(uint request, Tessellation *data);
 
     //! \brief Draws this object to the OpenGL buffer for picking. The caller must ensure that
-    //! the OpenGL context is current
+    //! the OpenGL context is current, and that the arenas are bound with bindArena().
     //!
-    //! This draws all **visible** and **selectable** components (as determined by \a mode) in
-    //! a single color each. The color used is determined by the global index of this
-    //! DisplayObject. The caller can then use glReadPixels and DisplayObject::colorToIndex to
-    //! find the objects in the selection area.
+    //! This draws all **visible** and **selectable** components (as determined by \a mode) to
+    //! an unsigned integer color buffer, each with the pair (index, offset), where index is the
+    //! global index of this DisplayObject and offset is the number of the component. Faces that
+    //! only hide other components are drawn with #PICK_NONE. The caller can then read the pairs
+    //! in the selection area with glReadPixels and GL_RG_INTEGER.
     //!
-    //! \param mvp The model-view-projection matrix to transform augmented 4-vectors from
-    //! model space to the OpenGL drawable surface.
-    //! \param prog The OpenGL shader program to use.
+    //! The shader finds faces from the vertex ranges of the faces, and edges from the primitive
+    //! ID, both in the range block of the object (see #rangeArena), so there is
+    //! one draw call for each run of consecutive visible components, rather than one per
+    //! component.
+    //!
+    //! The model-view-projection matrix is taken from the Camera uniform block.
+    //!
+    //! \param prog The picking program, linked with linkProgram().
     //! \param mode The current selection mode determines the appropriate coloring.
-    void drawPicking(QMatrix4x4 &mvp, QOpenGLShaderProgram &prog, SelectionMode mode);
+    void drawPicking(QOpenGLShaderProgram &prog, SelectionMode mode);
+
+    //! \brief Casts a ray against the components of this object that drawPicking() would draw.
+    //!
+    //! Edges and points count as hit within half their drawn width in pixels, and they are
+    //! treated as that much closer, so that they win over the faces they lie on. The object is
+    //! not modified, so rays can be cast from several threads holding DisplayObject::m shared.
+    //!
+    //! \param t The ray parameter of the nearest hit so far, updated if a nearer one is found.
+    //! \param regenerated If the geometry has been released in low memory mode, the ray is cast
+    //! against its regeneration here (see regenerationJobs()). Without one, nothing is hit.
+    //! \retval offset The component hit, or #PICK_NONE for a face hiding other components.
+    //! \return True if a nearer hit was found.
+    bool raycast(const PickRay &ray, SelectionMode mode, float *t, uint *offset,
+                 const RegeneratedGeometry &regenerated);
+
+    //! \brief Collects the visible components of this object that reach into the frustum,
+    //! whether they are occluded or not.
+    //!
+    //! Faces are found through the tiles. A face or edge counts as inside if one of its triangles
+    //! or segments reaches into the frustum, and a point if it lies inside. If \a inside is true,
+    //! the object is known to be entirely inside, and all visible components are taken without
+    //! any tests. Otherwise geometry that was released in low memory mode is regenerated for
+    //! the duration of the call (see regenerationJob()).
+    //!
+    //! \retval offsets The components found (see drawPicking()).
+    void xray(const Frustum &frustum, SelectionMode mode, bool inside, ComponentSet *offsets);
+
+    //! \brief Outlines a component as it would be picked, for highlighting under the cursor.
+    //!
+    //! Patches and faces are outlined by their edges. The caller should disable depth testing.
+    //!
+    //! \param prog The object program, linked with linkProgram(). The edges are drawn with its
+    //! line program.
+    //! \param offset The component, as read from the picking buffer (see drawPicking()).
+    void drawHover(QOpenGLShaderProgram &prog, SelectionMode mode, uint offset);
 
     //! Returns the center of the bounding sphere.
     inline QVector3D center() { return _center; };
@@ -134,6 +354,9 @@ public:
     //! Returns the radius of the bounding sphere.
     inline float radius() { return _radius; }
 
+    //! Returns the tiles of the faces (see Tile).
+    inline const std::vector<Tile> &tiles() { return geometry.tiles; }
+
     virtual uint nFaces() = 0; //!< Returns the number of faces in this object.
     virtual uint nEdges() = 0; //!< Returns the number of edges in this object.
     virtual uint nPoints() = 0; //!< Returns the number of points in this object.
@@ -144,8 +367,10 @@ public:
 
     //! \defgroup DisplayObjectComponents DisplayObject component manipulation tools
     //! Each DisplayObject maintains the sets #selectedFaces, #selectedEdges and #selectedPoints.
-    //! These are sets of integers denoting the indices of the selected components, and they
-    //! determine whether a component is drawn blue (unselected) or orange (selected).
+    //! These are sets (see ComponentSet) of the indices of the selected components, and they
+    //! determine whether a component is drawn blue (unselected) or orange (selected). The shader
+    //! reads the selection and visibility from #flagArena, which is updated for the objects in
+    //! #pendingFlags at the start of the next drawAll().
     //!
     //! The selection mode (ObjectSet::_selectionMode) has an impact on the functionality of
     //! many of these functions, but DisplayObject has no internal memory of the current selection
@@ -183,19 +408,19 @@ public:
     //!
     //! \param selected Whether to select or unselect.
     //! \param faces Set of face indices to change, between 0 and `nFaces() - 1` inclusive.
-    void selectFaces(bool selected, std::set<uint> faces);
+    void selectFaces(bool selected, const ComponentSet &faces);
 
     //! \brief Select or unselect edges. Assumes selection mode is `SM_EDGE`.
     //!
     //! \param selected Whether to select or unselect.
     //! \param edges Set of edge indices to change, between 0 and `nEdges() - 1` inclusive.
-    void selectEdges(bool selected, std::set<uint> edges);
+    void selectEdges(bool selected, const ComponentSet &edges);
 
     //! \brief Select or unselect vertices. Assumes selection mode is `SM_POINT`.
     //!
     //! \param selected Whether to select or unselect.
     //! \param points Set of vertices indices to change, between 0 and `nPoints() - 1` inclusive.
-    void selectPoints(bool selected, std::set<uint> points);
+    void selectPoints(bool selected, const ComponentSet &points);
 
     //! Check whether the object has any selected components.
     inline bool hasSelection()
@@ -221,19 +446,19 @@ public:
     //! \param countPoints Whether an invisible vertex counts as being invisibile.
     inline bool isFullyVisible(bool countPoints)
     {
-        return (visibleFaces.size() == nFaces() &&
-                visibleEdges.size() == nEdges() &&
-                (countPoints ? visiblePoints.size() == nPoints() : true));
+        return (visibleFaces.count() == nFaces() &&
+                visibleEdges.count() == nEdges() &&
+                (countPoints ? visiblePoints.count() == nPoints() : true));
     }
 
     //! Check whether a given face is selected
-    inline bool faceSelected(uint i) { return selectedFaces.find(i) != selectedFaces.end(); }
+    inline bool faceSelected(uint i) { return selectedFaces.contains(i); }
 
     //! Check whether a given edge is selected.
-    inline bool edgeSelected(uint i) { return selectedEdges.find(i) != selectedEdges.end(); }
+    inline bool edgeSelected(uint i) { return selectedEdges.contains(i); }
 
     //! Check whether a given vertex is selected.
-    inline bool pointSelected(uint i) { return selectedPoints.find(i) != selectedPoints.end(); }
+    inline bool pointSelected(uint i) { return selectedPoints.contains(i); }
 
     //! \brief Shows or hides the currently selected components.
     //!
@@ -245,14 +470,9 @@ public:
 
 
     //! \defgroup DisplayObjectIndex DisplayObject indexing system
-    //! In order to do selection with the mouse, each DisplayObject is assigned a number of unique
-    //! colors (#COLORS_PER_OBJECT). Currently this is 12, because this is the maximum needed, by
-    //! Volume objects in edge selection mode. With 16 million colors (#NUM_COLORS), this gives
-    //! about 1.4 million available color slots for objects to use (#NUM_INDICES).
-    //!
-    //! - By **index** we mean an integer between 0 and #NUM_INDICES-1.
-    //! - By **key** we mean an integer between 0 and #NUM_COLORS-1. A key is simply a numerical
-    //!   representation of a color. There are #COLORS_PER_OBJECT keys to each index.
+    //! In order to do selection with the mouse, each DisplayObject is assigned a unique
+    //! **index**, an integer below #PICK_NONE. The picking pass writes the index together with
+    //! the component number (the **offset**) to an integer buffer (see drawPicking()).
     //!
     //! The mapping from indices to objects is stored in #indexMap.
     //!
@@ -268,28 +488,17 @@ public:
     //! - Destroying a DisplayObject
     //! - Interacting with the index.
     //!
+    //! Queries that only read, such as raycastAll(), can hold it shared (see SharedMutex), so
+    //! that they run in parallel.
+    //!
     //! **It is always the caller's responsibility to lock this mutex. No methods belonging to
     //! DisplayObject, static or otherwise, will lock it.**
-    static std::mutex m;
+    static SharedMutex m;
 
     //! \brief Returns the DisplayObject associated with the given index, or NULL if it doesn't exist.
     //! DisplayObject::m should be locked before calling.
     static DisplayObject *getObject(uint idx);
 
-    //! \brief Convert color to key. By "key" we mean strictly a numerical representation of colors,
-    //! i.e. (0,0,0) => 0, (0,0,1) => 1, (0,1,0) => 256, and so on.
-    static uint colorToKey(GLubyte color[3]);
-
-    //! \brief Convert key to index.
-    //!
-    //! \param key The key to convert.
-    //! \retval index The index associated with this key (key / #COLORS_PER_OBJECT).
-    //! \retval offset The offset (key % #COLORS_PER_OBJECT). 
-    static void keyToIndex(uint key, uint *index, uint *offset);
-
-    //! \brief Utility function to convert a color directly to an index.
-    static void colorToIndex(GLubyte color[3], uint *index, uint *offset);
-
     //! For iterating over #indexMap.
     typedef typename std::map<uint, DisplayObject *>::iterator iterator;
 
@@ -301,6 +510,149 @@ public:
     //! DisplayObject::m should be locked during iteration.
     static iterator end() { return indexMap.end(); }
 
+    //! \brief Calls initialize() on all objects in #pendingUploads, and clears it. The caller
+    //! must ensure that the OpenGL context is current. DisplayObject::m should be locked before
+    //! calling.
+    static void uploadPending();
+
+    //! \brief Draws all initialized objects to the OpenGL buffer. The caller must ensure that the
+    //! OpenGL context is current. DisplayObject::m should be locked before calling.
+    //!
+    //! The draws of all objects are collected into batches sharing primitive type, normal offset
+    //! and index type, and each batch is drawn with a single multi-draw call. The shader finds
+    //! the component of each primitive, from the face attribute for faces and element lines, and
+    //! from the primitive ID for edges and points, and takes its color and visibility from
+    //! #flagArena. Faces and element lines are drawn in runs of visible faces, and edges and
+    //! points in one range per object starting at the first component, so changing the selection
+    //! does not change the draws. The model-view-projection matrix is taken from the Camera
+    //! uniform block.
+    //!
+    //! Objects outside the frustum are culled with cull(). Of objects that are only partially
+    //! inside, only the tiles inside are drawn (see Tile). With occlusion culling on, objects
+    //! that were occluded in the last frame are only drawn where their bounding box passes the
+    //! depth test (see setOcclusionCulling()).
+    //!
+    //! \param prog The OpenGL shader program to use.
+    //! \param frustum The view frustum of the model-view-projection matrix.
+    //! \param showPoints Whether to draw the vertices or not.
+    //! \retval culled The number of culled objects, if not NULL.
+    //! \retval occluded The number of objects held back as occluded, if not NULL.
+    //! \return The number of draw calls issued.
+    static uint drawAll(QOpenGLShaderProgram &prog, const Frustum &frustum, bool showPoints,
+                        uint *culled = NULL, uint *occluded = NULL);
+
+    //! \brief Calls \a visit for each visible object whose bounding sphere is not outside the
+    //! frustum. DisplayObject::m should be locked before calling.
+    //!
+    //! The objects are found through #boundingTree, so objects far outside the frustum are
+    //! rejected in groups. The second argument to \a visit is *true* if the object is entirely
+    //! inside. Objects that are not yet initialized may be visited.
+    //!
+    //! \return The number of culled objects.
+    template <typename F>
+    static uint cull(const Frustum &frustum, F visit);
+
+    //! \brief The bounding volume hierarchy over all visible objects, with the object indices as
+    //! values. This is the acceleration structure for culling, picking and framing.
+    //! DisplayObject::m should be locked while using it.
+    static inline const BoundingTree &hierarchy() { return boundingTree; }
+
+    //! \brief The bounding volume hierarchy over the tiles of this object (see Tile), with the
+    //! tile indices as values.
+    inline const BoundingTree &tileHierarchy() { return tileTree; }
+
+    //! \brief Links the object shader program. The caller must ensure that the OpenGL context
+    //! is current.
+    //!
+    //! The vertex attributes are bound to fixed locations (#ATTRIBUTE_POSITION etc.), so that the
+    //! vertex array objects of the arenas are valid for the program. The Camera block is bound to
+    //! #CAMERA_BINDING, and the uniform locations are cached in #locations.
+    //!
+    //! The core profile has no lines wider than one pixel, so element lines and edges are drawn
+    //! by a line program, with a geometry shader widening each line into a quad. The line
+    //! program goes with the object program, or with the picking program (see drawPicking()),
+    //! and both must be linked before drawing.
+    //!
+    //! \param picking Whether this is the picking program.
+    //! \param lines Whether this is a line program.
+    //! \return True on success.
+    static bool linkProgram(QOpenGLShaderProgram &prog, bool picking = false, bool lines = false);
+
+    //! \brief Finds the nearest component hit by a ray among the visible objects, using
+    //! #boundingTree and raycast(). This needs no OpenGL context. DisplayObject::m should be
+    //! locked, at least shared, before calling.
+    //!
+    //! \param regenerated The released geometry of the objects the ray may hit (see
+    //! regenerationJobs()).
+    //! \retval index The index of the object hit, or #PICK_NONE.
+    //! \retval offset The component hit (see drawPicking()).
+    static void raycastAll(const PickRay &ray, SelectionMode mode, uint *index, uint *offset,
+                           const RegeneratedGeometry &regenerated);
+
+    //! \brief Collects the jobs regenerating the released geometry (see regenerationJob()) of
+    //! the visible objects reaching into the frustum, for raycastAll(). The jobs can then be run
+    //! without any locks held. DisplayObject::m should be locked, at least shared, before calling.
+    //!
+    //! \retval jobs The jobs, by object index.
+    static void regenerationJobs(const Frustum &frustum,
+                                 std::vector<std::pair<uint, std::function<void(Tessellation &)>>> *jobs);
+
+    //! \brief Finds all visible components reaching into the frustum, at any depth, using cull()
+    //! and xray(). This needs no OpenGL context. DisplayObject::m should be locked before calling.
+    //!
+    //! \retval picks The (index, offset) pairs found.
+    static void xrayAll(const Frustum &frustum, SelectionMode mode, std::set<std::pair<uint,uint>> *picks);
+
+    //! \brief Binds the vertex array object of the shared arenas in the current format, and
+    //! sets the uniforms needed to decode them. The caller must ensure that the OpenGL context
+    //! is current, and that the program has been linked with linkProgram().
+    //!
+    //! The vertex array object is set up again only when one of the arenas has been moved to a
+    //! new buffer. It stays bound after the call, so the caller should bind its own vertex array
+    //! object before drawing anything else.
+    static void bindArena(QOpenGLShaderProgram &prog);
+
+    //! Check whether the compact buffer format is used (see setCompact()).
+    static inline bool compact() { return _compact; }
+
+    //! \brief Switches between the full and the compact buffer format.
+    //!
+    //! The full format uses float positions and normals (see #fullVertex) and 32-bit indices. The
+    //! compact format stores positions quantized to 16 bits within the bounding box and octahedral
+    //! normals in two bytes (see #packedVertex), and uses 16-bit indices for objects with fewer
+    //! than 65536 vertices. The bounding boxes are kept in #quantArena, indexed by the object
+    //! index, which the shaders find from #pageArena. All initialized objects are added to
+    //! #pendingUploads to be converted.
+    //! DisplayObject::m should be locked before calling.
+    static void setCompact(bool compact);
+
+    //! Check whether occlusion culling is on (see setOcclusionCulling()).
+    static inline bool occlusionCulling() { return _occlusionCulling; }
+
+    //! \brief Switches occlusion culling on or off.
+    //!
+    //! Each frame, the objects that were visible in the last frame are drawn first. Then the
+    //! bounding box of every object in the frustum is tested against the depth buffer with an
+    //! occlusion query. The objects that were occluded in the last frame are drawn with
+    //! conditional rendering on their query, so an object that comes into view is drawn in the
+    //! same frame, and the CPU never waits for a query. The results are read back in the next
+    //! frame, when they are available. Objects reaching the near plane are never held back,
+    //! since their boxes may be clipped. DisplayObject::m should be locked before calling.
+    static void setOcclusionCulling(bool occlusionCulling);
+
+    //! Check whether low memory mode is on (see setLowMemory()).
+    static inline bool lowMemory() { return _lowMemory; }
+
+    //! \brief Switches low memory mode on or off.
+    //!
+    //! In low memory mode, the vertex and index data of the tessellation are dropped once they
+    //! have been uploaded to the GPU. The face, element and edge ranges and the tiles are kept,
+    //! since they are needed for drawing. Queries such as raycast() and xray() work on a
+    //! temporary regeneration of the data (see regenerationJob()). Switching it on releases the
+    //! data of all initialized objects immediately.
+    //! DisplayObject::m should be locked before calling.
+    static void setLowMemory(bool lowMemory);
+
     //! @}
 
 protected:
@@ -309,56 +661,27 @@ protected:
 
 
     //! \defgroup DisplayObjectSubclassing DisplayObject subclassing
-    //! The constructor of the subclass should populate each of these members. They define the
-    //! shape and topology of the DisplayObject, necessary for the \ref DisplayObjectComponents
-    //! and the OpenGL drawing functions to work.
+    //! The constructor of the subclass should populate each of these members, and call tessellate()
+    //! to fill in #geometry. They define the shape of the DisplayObject, necessary for the
+    //! \ref DisplayObjectComponents and the OpenGL drawing functions to work. For tensor product
+    //! patches, Tessellator can generate all of them. The topology is given by type() (see
+    //! Topology).
     //!
     //! @{
 
-    //! The vertices of this object. The order is not important (for the superclass).
-    std::vector<QVector3D> vertexData;
-
-    //! The outward-facing normals (if applicable). The indexing must correspond to #vertexData.
-    std::vector<QVector3D> normalData;
-
-    //! A quad of indices for each quadrilateral polygon to draw. Indices must correspond to #vertexData.
-    std::vector<quad> faceData;
-
-    //! \brief A pair of indices for each element line to draw. These are the thin blue lines
-    //! inside faces. Indices must correspond to #vertexData.
-    std::vector<pair> elementData;
-
-    //! \brief A pair of indices for each edge to draw. These are the thick black lines denoting
-    //! the actual topological edges. Indices must correspond to #vertexData.
-    std::vector<pair> edgeData;
+    //! The current geometry of this object.
+    Tessellation geometry;
 
-    //! \brief An index for each vertex to draw. These are drawn as black circles.
-    //! Indices must correspond to #vertexData.
-    std::vector<GLuint> pointData;
 
     //! The indices of the visible faces.
-    std::set<uint> visibleFaces;
+    ComponentSet visibleFaces;
 
     //! The indices of the visible edges.
-    std::set<uint> visibleEdges;
+    ComponentSet visibleEdges;
 
     //! \brief The indices of the visible vertices. Note that vertex drawing can be overridden.
     //! The vertices should still be visible internally!
-    std::set<uint> visiblePoints;
-
-    //! \brief Index bounds for faces.
-    //!
-    //! Should be of size nFaces()+1. E.g. if the first 20 entries in #faceData make up the first
-    //! face, and the second 40 make up the second face, then #faceIdxs should be {0,20,60}.
-    //! Used by draw() to find the right indices when not all faces are visible.
-    std::vector<uint> faceIdxs;
-
-    //! \brief Index bounds for elements. Works like #faceIdxs, but for #elementData.
-    std::vector<uint> elementIdxs;
-
-    //! \brief Index bounds for edges. Works like #faceIdxs, but for #edgeData.
-    std::vector<uint> edgeIdxs;
-
+    ComponentSet visiblePoints;
 
     //! \brief Normal offsets used for drawing faces.
     //!
@@ -379,22 +702,16 @@ protected:
     //! \brief Normal offsets used for drawing edges. See #faceOffsets.
     std::vector<float> pointOffsets;
 
-    //! A map from face index to edge indices describing the topology of this object.
-    std::unordered_map<uint, quad> faceEdgeMap;
-
-    //! A map from edge index to vertex indices describing the topology of this object.
-    std::unordered_map<uint, pair> edgePointMap;
-
     //! @}
 
 
     //! \brief Computes (estimates) the minimal bounding sphere of this object using
-    //! #vertexData, and saves the results to #_center and #_radius.
+    //! Tessellation::vertexData, and saves the results to #_center and #_radius.
     void computeBoundingSphere();
 
-    //! Utility function that refines a vector *knot* of knot values by inserting *ref*
-    //! points in each element, storing the results in *params*.
-    static void mkSamples(const std::vector<double> &knots, std::vector<double> &params, uint ref);
+    //! \brief Runs tessellationJob() synchronously, storing the results in #geometry, and
+    //! computes the bounding sphere. To be called by subclass constructors.
+    void tessellate(float quality);
 
 private:
     //! Index of this object. (See \ref DisplayObjectIndex for details.)
@@ -403,38 +720,109 @@ private:
     //! True if this object has been initialized.
     bool _initialized;
 
-    //! The Patch object that owns this.
-    Patch *_patch;
+    //! True if the buffers of this object are in the compact format (see setCompact()).
+    bool _bufferCompact;
 
+    //! True if the CPU-side geometry has been released (see setLowMemory()).
+    bool _geometryReleased;
 
-    //! \addtogroup DisplayObjectComponents
-    //! @{
-    std::set<uint> selectedFaces;
-    std::set<uint> selectedEdges;
-    std::set<uint> selectedPoints;
-    //! @}
+    //! The leaf of this object in #boundingTree, or #BOUNDINGTREE_NULL if invisible.
+    uint boundingLeaf;
+
+    //! The bounding spheres of the tiles (see tileHierarchy()).
+    BoundingTree tileTree;
+
+    //! The leaf of each tile in #tileTree.
+    std::vector<uint> tileLeaves;
+
+    //! The occlusion query of this object, or zero (see setOcclusionCulling()).
+    GLuint occlusionQuery;
+
+    //! True if #occlusionQuery has been issued and its result not yet read.
+    bool queryIssued;
+
+    //! True if the last read result of #occlusionQuery was that no samples passed.
+    bool occluded;
+
+    //! Updates #occluded from #occlusionQuery, if the result is available.
+    void readOcclusion();
+
+    //! \brief Updates #tileTree, and moves the leaf of this object in #boundingTree. To be called
+    //! when the geometry changes, after computeBoundingSphere().
+    //!
+    //! The tiles of a patch are the same at every quality (see Tessellator), so a new tessellation
+    //! only moves the leaves. The tree is rebuilt if the number of tiles has changed.
+    void updateBounds();
+
+    //! \brief Inserts, moves or removes the leaf of this object in #boundingTree, depending on
+    //! whether it is visible.
+    void updateLeaf();
+
+    //! Frees the vertex and index data of #geometry, keeping the ranges and the tiles.
+    void releaseGeometry();
+
+    //! The type of the indices in the index block (\c GL_UNSIGNED_INT or \c GL_UNSIGNED_SHORT).
+    GLenum indexType;
+
+    //! Offset of the vertex block of this object in #vertexArena, in bytes.
+    uint vertexBlock;
+
+    //! Offset of the index block of this object in #indexArena, in bytes.
+    uint indexBlock;
+
+    //! Offset of the range block of this object in #rangeArena, in bytes.
+    uint rangeBlock;
+
+    //! Offset of the flag block of this object in #flagArena, in bytes.
+    uint flagBlock;
+
+    //! Writes the flags of all components of this object to #flagArena.
+    void writeFlags();
+
+    //! \brief Positions of Tessellation::faceData, Tessellation::elementData,
+    //! Tessellation::edgeData and Tessellation::pointData in the index block, in indices.
+    uint faceStart, elementStart, edgeStart, pointStart;
+
+    //! Returns the base vertex of this object in #vertexArena.
+    inline GLint baseVertex()
+    {
+        return vertexBlock / (_bufferCompact ? sizeof(packedVertex) : sizeof(fullVertex));
+    }
+
+    //! Returns the offset of the given index in the index block in #indexArena, in bytes.
+    inline size_t indexOffset(uint start)
+    {
+        return indexBlock + start * (indexType == GL_UNSIGNED_SHORT ? sizeof(GLushort) : sizeof(GLuint));
+    }
+
+    //! Frees the blocks of this object in the arenas.
+    void freeBlocks();
 
+    //! The quality of the newest requested tessellation. The uploaded one is in #geometry.
+    float _quality;
 
-    //! OpenGL buffer corresponding to #vertexData.
-    QOpenGLBuffer vertexBuffer;
+    //! Returns tessellationJob(), recording the quality in the tessellation.
+    std::function<void(Tessellation &)> stampedJob(float quality);
 
-    //! OpenGL buffer corresponding to #normalData.
-    QOpenGLBuffer normalBuffer;
+    //! The newest request for a tessellation (see requestTessellation()).
+    uint _request;
 
-    //! OpenGL buffer corresponding to #faceData.
-    QOpenGLBuffer faceBuffer;
+    //! A tessellation waiting to be uploaded by initialize(), or NULL.
+    std::unique_ptr<Tessellation> pending;
 
-    //! OpenGL buffer corresponding to #elementData.
-    QOpenGLBuffer elementBuffer;
+    //! The Patch object that owns this.
+    Patch *_patch;
 
-    //! OpenGL buffer corresponding to #edgeData.
-    QOpenGLBuffer edgeBuffer;
 
-    //! OpenGL buffer corresponding to #pointData.
-    QOpenGLBuffer pointBuffer;
+    //! \addtogroup DisplayObjectComponents
+    //! @{
+    ComponentSet selectedFaces;
+    ComponentSet selectedEdges;
+    ComponentSet selectedPoints;
+    //! @}
 
 
-    //! \brief Computes, among the points in #vertexData, the one farthest from *point*.
+    //! \brief Computes, among the points in Tessellation::vertexData, the one farthest from *point*.
     //!
     //! \retval found The most distant point.
     void farthestPointFrom(QVector3D point, QVector3D *found);
@@ -445,6 +833,9 @@ private:
     void ritterSphere();
 
 
+    //! Returns the adjacency of the components, which is shared by all objects of the same type.
+    inline const Topology &topology() { return Topology::of(type()); }
+
     //! Selects only those edges that are neighboring a selected face.
     void refreshEdgesFromFaces();
 
@@ -462,23 +853,84 @@ private:
     //! If *false*, it needs only one.
     void balloonPointsToEdges(bool conjunction);
 
-    //! Creates and binds an OpenGL buffer with static draw usage pattern.
-    static void createBuffer(QOpenGLBuffer &buffer);
+    struct DrawList;
 
-    //! \brief Binds an OpenGL buffer to the given program.
-    //! \param prog Program to bind to.
-    //! \param buffer OpenGL buffer object to bind.
-    //! \param attribute Program attribute to bind to.
-    static void bindBuffer(QOpenGLShaderProgram &prog, QOpenGLBuffer &buffer, const char *attribute);
+    //! \brief Adds the draws of this object to a list of batches (see drawAll()).
+    //! \param frustum If not NULL, faces and elements are only drawn for tiles inside it.
+    void addDraws(DrawList &list, bool showPoints, const Frustum *frustum);
+
+    //! Draws the batches of a list, and returns the number of draw calls.
+    static uint drawList(QOpenGLShaderProgram &prog, DrawList &list);
 
-    //! \brief Sets the uniform values in the shader program.
+    //! \brief Issues the occlusion queries for \a tested, and draws those that were occluded in
+    //! the last frame with conditional rendering (see setOcclusionCulling()). The second element
+    //! of each pair tells whether the object is entirely inside the frustum.
+    //! \return The number of draw calls.
+    static uint drawOccluded(QOpenGLShaderProgram &prog, const Frustum &frustum, bool showPoints,
+                             const std::vector<std::pair<DisplayObject *, bool>> &tested);
+
+    //! \brief Sets the uniform values in the shader program, using the cached #locations.
     //! \param prog Program to bind to.
-    //! \param mvp Model-view-projection matrix to transform augmented 4-vectors from model space
-    //! to the drawing surface.
     //! \param col Color to draw in .
     //! \param p Normal offset (see #faceOffsets).
-    static void setUniforms(QOpenGLShaderProgram& prog, QMatrix4x4 mvp, QVector3D col, float p);
-    static void setUniforms(QOpenGLShaderProgram& prog, QMatrix4x4 mvp, uchar *col, float p);
+    static void setUniforms(QOpenGLShaderProgram& prog, QVector3D col, float p);
+
+    //! \brief Sets how the object program colors the components, using the cached #locations.
+    //! \param prog Program to bind to.
+    //! \param lookup Which components are drawn.
+    //! \param col Color of unselected components.
+    //! \param colSelected Color of selected components.
+    static void setColors(QOpenGLShaderProgram& prog, ColorLookup lookup, QVector3D col,
+                          QVector3D colSelected);
+
+    //! Sets the width of the lines drawn by a line program, in pixels (see linkProgram()).
+    static void setLineWidth(QOpenGLShaderProgram &prog, float width);
+
+    //! \brief Sets the uniform values in the picking program, using the cached #locations.
+    //! \param prog Program to bind to.
+    //! \param index Object index to write.
+    //! \param offset Component number to write.
+    //! \param p Normal offset (see #faceOffsets).
+    static void setPickUniforms(QOpenGLShaderProgram& prog, uint index, uint offset, float p);
+
+    //! \brief Sets how the picking program finds the component of a fragment.
+    //! \param prog Program to bind to.
+    //! \param lookup The lookup method.
+    //! \param start Offset of the table in #rangeArena, in entries (for #PL_RANGES).
+    //! \param count Number of components in the table (for #PL_RANGES).
+    static void setPickLookup(QOpenGLShaderProgram& prog, PickLookup lookup, uint start = 0, uint count = 0);
+
+    //! \brief Draws the runs of consecutive visible components with the picking program. The
+    //! primitive ID of the first primitive in each run is passed to the shader.
+    //! \param prog Program to bind to.
+    //! \param mode The primitive type.
+    //! \param first Offset of the first index in #indexArena, in bytes.
+    //! \param visible The visible components.
+    //! \param indices Index bounds of the components (see Tessellation::faceIdxs), or empty, if
+    //! each component is a single index.
+    void drawPickRuns(QOpenGLShaderProgram& prog, GLenum mode, size_t first, const ComponentSet &visible,
+                      const std::vector<uint> &indices);
+
+    //! Uniform locations of an object shader program.
+    struct Locations { QOpenGLShaderProgram *prog; bool picking; int col, colSelected, p, compact,
+            quantBoxes, id, lookup, primitiveBase, rangeStart, rangeCount, ranges, flags, objects,
+            pages, lineWidth; };
+
+    //! \brief The cached uniform locations of the programs linked with linkProgram(), for the
+    //! object and picking programs and their line programs.
+    static Locations locations[4];
+
+    //! Returns the index of a program in #locations.
+    static inline uint programIndex(bool picking, bool lines)
+    {
+        return (picking ? 1 : 0) + (lines ? 2 : 0);
+    }
+
+    //! Returns the cached uniform locations of a program linked with linkProgram().
+    static Locations &locationsOf(const QOpenGLShaderProgram &prog);
+
+    //! Returns the line program going with an object or picking program, and binds it.
+    static QOpenGLShaderProgram &bindLines(const QOpenGLShaderProgram &prog);
 
     //! \addtogroup DisplayObjectIndex
     //! @{
@@ -487,9 +939,119 @@ private:
     //! DisplayObject::m should be locked before manipulating.
     static std::map<uint, DisplayObject *> indexMap;
 
-    //! The next available index, used by #registerObject as a cache.
+    //! \brief The lowest index that may be free, used by #registerObject as a cache. All
+    //! indices below it are in use, so freed indices are handed out again first.
     static uint nextIndex;
 
+    //! The last issued tessellation request identifier.
+    static uint lastRequest;
+
+    //! Whether new buffers are made in the compact format (see setCompact()).
+    static bool _compact;
+
+    //! Whether CPU-side geometry is released after uploading (see setLowMemory()).
+    static bool _lowMemory;
+
+    //! Whether occlusion culling is on (see setOcclusionCulling()).
+    static bool _occlusionCulling;
+
+    //! Occlusion queries released by destroyed objects, for reuse.
+    static std::vector<GLuint> queryPool;
+
+    //! The buffer and vertex array object for the bounding boxes in occlusion tests, or zero.
+    static GLuint boxBuffer, boxArray;
+
+    //! \brief Scratch storage for drawAll(), kept between frames so that drawing does not
+    //! allocate once the vectors have grown to size.
+    static DrawList frameList, occludedList;
+    static std::vector<std::pair<DisplayObject *, bool>> occlusionTested;
+    static std::vector<GLfloat> occlusionBoxes;
+    static std::vector<uint> tilesInside;
+
+    //! Scratch storage for writeFlags().
+    static std::vector<GLubyte> flagData;
+
+    //! \brief The shared vertex arenas, for the full and the compact format. Block offsets are
+    //! multiples of #VERTEX_PAGE vertices.
+    static GeometryArena vertexArena[2];
+
+    //! \brief The object index of each page of #VERTEX_PAGE vertices in #vertexArena, for each
+    //! format. The shaders find the object of a vertex here, so it is not stored with the
+    //! vertices. Used as a texture buffer (#pageTextures).
+    static GeometryArena pageArena[2];
+
+    //! The texture buffer objects for #pageArena, or zero.
+    static GLuint pageTextures[2];
+
+    //! The generations of #pageArena attached to #pageTextures.
+    static uint pageGenerations[2];
+
+    //! The shared index arena.
+    static GeometryArena indexArena;
+
+    //! \brief The quantization boxes of the compact format, as four floats for each object
+    //! index: the lower corner and the size. Used as a texture buffer (#quantTexture).
+    static GeometryArena quantArena;
+
+    //! The texture buffer object for #quantArena, or zero.
+    static GLuint quantTexture;
+
+    //! The generation of #quantArena attached to #quantTexture.
+    static uint quantGeneration;
+
+    //! \brief Tables of the components of each primitive, for the object and picking programs.
+    //! Each object has a block with the first and one past the last vertex of each face in
+    //! #vertexArena, followed by the line bounds of its edges (Tessellation::edgeIdxs). Used as
+    //! a texture buffer (#rangeTexture).
+    static GeometryArena rangeArena;
+
+    //! The texture buffer object for #rangeArena, or zero.
+    static GLuint rangeTexture;
+
+    //! The generation of #rangeArena attached to #rangeTexture.
+    static uint rangeGeneration;
+
+    //! \brief The flags of all components, one byte each (#COMPONENT_VISIBLE and
+    //! #COMPONENT_SELECTED). Each object has a block with its faces, edges and points, in that
+    //! order. Used as a texture buffer (#flagTexture).
+    static GeometryArena flagArena;
+
+    //! The texture buffer object for #flagArena, or zero.
+    static GLuint flagTexture;
+
+    //! The generation of #flagArena attached to #flagTexture.
+    static uint flagGeneration;
+
+    //! \brief Where the programs find the tables of each object, as four integers for each object
+    //! index: the range block in #rangeArena and the flag block in #flagArena, in entries, and
+    //! the number of faces and edges. Used as a texture buffer (#objectTexture).
+    static GeometryArena objectArena;
+
+    //! The texture buffer object for #objectArena, or zero.
+    static GLuint objectTexture;
+
+    //! The generation of #objectArena attached to #objectTexture.
+    static uint objectGeneration;
+
+    //! \brief Indices of the objects whose selection or visibility has changed since their flags
+    //! were last written. DisplayObject::m should be locked before manipulating.
+    static std::set<uint> pendingFlags;
+
+    //! \brief The bounding spheres of all visible objects (see hierarchy()). It is updated when
+    //! objects are created, destroyed, retessellated, shown or hidden.
+    static BoundingTree boundingTree;
+
+    //! The vertex array objects of the full and the compact format, or zero.
+    static GLuint arenaArrays[2];
+
+    //! \brief The generations of the vertex arena and #indexArena recorded in each of
+    //! #arenaArrays.
+    static std::pair<uint,uint> arrayGenerations[2];
+
+    //! \brief Indices of the objects with a pending tessellation or buffer format change.
+    //! DisplayObject::m should be locked before manipulating.
+    static std::set<uint> pendingUploads;
+
     //! \brief Register a new DisplayObject and get an index.
     //! DisplayObject::m should be locked before calling.
     static uint registerObject(DisplayObject *obj);
@@ -498,10 +1060,19 @@ private:
     //! DisplayObject::m should be locked before calling.
     static void deregisterObject(uint index);
 
-    //! \brief Convert an index to a color.
-    static QVector3D indexToColor(uint index, uint offset);
-
     //! @}
 };
 
+
+template <typename F>
+uint DisplayObject::cull(const Frustum &frustum, F visit)
+{
+    uint visited = 0;
+    boundingTree.query(frustum, [&visit, &visited] (uint index, bool inside) {
+        visit(indexMap.find(index)->second, inside);
+        visited++;
+    });
+    return boundingTree.size() - visited;
+}
+
 #endif /* _DISPLAYOBJECT_H_ */
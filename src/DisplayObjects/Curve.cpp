@@ -38,31 +38,18 @@
  * written agreement between you and SINTEF ICT.
  */
 
+#include "BasisCache.h"
+#include "Tessellator.h"
 #include "DisplayObjects/Curve.h"
 
 
-Curve::Curve(Go::SplineCurve *c)
+float Curve::tolerance = CURVE_DEFAULT_TOLERANCE;
+
+
+Curve::Curve(Go::SplineCurve *c, float quality)
     : DisplayObject()
     , crv(c)
 {
-    c->basis().knotsSimple(knots);
-
-
-    // Pre refinement
-    nt = knots.size() - 1;
-    ntPts = nt + 1;
-
-
-    // Refinement
-    r = (c->order() - 1) * (c->rational() ? 5 : 1);
-    mkSamples(knots, params, r);
-
-
-    // Post refinement
-    n = params.size() - 1;
-    nPts = n + 1;
-
-
     // Visibility
     visibleFaces = {};
     visibleEdges = {0};
@@ -76,53 +63,28 @@ Curve::Curve(Go::SplineCurve *c)
     pointOffsets = {0.0};
 
 
-    // Indexes
-    faceIdxs = {};
-    elementIdxs = {};
-    edgeIdxs = {0, n};
-
-
-    // Maps
-    faceEdgeMap = {};
-    edgePointMap = {{0, {0,1}}};
-
-
     // Make data
-    mkData();
-
-
-    // Compute bounding sphere
-    computeBoundingSphere();
-}
-
-
-Curve::~Curve()
-{
-    delete crv;
+    tessellate(quality);
 }
 
 
-void Curve::mkData()
+std::function<void(Tessellation &)> Curve::tessellationJob(float quality)
 {
-    vertexData.resize(nPts);
-    normalData.resize(nPts);
+    std::shared_ptr<Go::SplineCurve> c = crv;
+    float tol = tolerance;
 
-    std::vector<double> points;
-    crv->gridEvaluator(points, params);
-    for (uint i = 0; i < nPts; i++)
-    {
-        vertexData[i] = QVector3D(points[3*i], points[3*i+1], points[3*i+2]);
-        normalData[i] = QVector3D(0,0,0);
-    }
+    return [c, quality, tol] (Tessellation &out) {
+        std::vector<double> knots[1];
+        c->basis().knotsSimple(knots[0]);
 
-    faceData.resize(0);
-    elementData.resize(0);
+        uint ref[1] = { Tessellator<1>::refinement((c->order() - 1) * (c->rational() ? 5 : 1), quality) };
 
-    edgeData.resize(n);
-    for (uint i = 0; i < n; i++)
-        edgeData[i] = { i, i+1 };
+        Tessellator<1>(knots, ref).tessellate(
+            out, [&c] (uint, const std::vector<double> &params, const std::vector<double> &,
+                       std::vector<double> &points, std::vector<double> &, std::vector<double> &) {
+                BasisCache::gridEvaluator(c.get(), params, points);
+            });
 
-    pointData.resize(2);
-    pointData[0] = 0;
-    pointData[1] = n;
+        Tessellator<1>::simplify(out, tol);
+    };
 }
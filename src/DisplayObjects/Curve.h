@@ -45,11 +45,12 @@
 #ifndef CURVE_H
 #define CURVE_H
 
+#define CURVE_DEFAULT_TOLERANCE 1e-4
+
 class Curve : public DisplayObject
 {
 public:
-    Curve(Go::SplineCurve *crv);
-    ~Curve();
+    Curve(Go::SplineCurve *crv, float quality = 1.0);
 
     ObjectType type() { return OT_CURVE; }
 
@@ -57,21 +58,14 @@ public:
     uint nEdges() { return 1; }
     uint nPoints() { return 2; }
 
-private:
-    // Pre refinement
-    uint nt, ntPts;
-
-    // Refinement
-    uint r;
+    std::function<void(Tessellation &)> tessellationJob(float quality);
 
-    // Post refinement
-    uint n, nPts;
+    //! \brief Relative tolerance for polyline simplification (see Tessellator::simplify), or
+    //! zero to disable it. DisplayObject::m should be locked when accessing.
+    static float tolerance;
 
-    // Other data
-    Go::SplineCurve *crv;
-    std::vector<double> knots, params;
-
-    void mkData();
+private:
+    std::shared_ptr<Go::SplineCurve> crv;
 };
 
 #endif /* CURVE_H */
@@ -48,8 +48,7 @@
 class Surface : public DisplayObject
 {
 public:
-    Surface(Go::SplineSurface *srf);
-    ~Surface();
+    Surface(Go::SplineSurface *srf, float quality = 1.0);
 
     ObjectType type() { return OT_SURFACE; }
 
@@ -57,36 +56,10 @@ public:
     uint nEdges() { return 4; }
     uint nPoints() { return 4; }
 
-private:
-    // Pre refinement
-    uint ntU, ntV;
-    uint ntPtsU, ntPtsV, ntPts;
-    uint ntElems;
-
-    // Refinement
-    uint rU, rV;
-
-    // Post refinement
-    uint nU, nV;
-    uint nPtsU, nPtsV, nPts, nElems, nElemLines;
+    std::function<void(Tessellation &)> tessellationJob(float quality);
 
-    // Other data
-    Go::SplineSurface *srf;
-    std::vector<double> uKnots, vKnots;
-    std::vector<double> uParams, vParams;
-
-    void mkVertexData();
-    void mkFaceData();
-    void mkElementData();
-    void mkEdgeData();
-    void mkPointData();
-
-    inline uint pt(uint i, uint j) { return nPtsU*j + i; }
-    inline uint face(uint i, uint j) { return nU*j + i; }
-    inline uint uElmt(uint i, uint j) { return nU*j + i; }
-    inline uint vElmt(uint i, uint j) { return nU*(ntV-1) + nV*j + i; }
-    inline uint uEdge(uint i, bool posV) { return (posV ? nU : 0) + i; }
-    inline uint vEdge(uint i, bool posU) { return 2*nU + (posU ? nV : 0) + i; }
+private:
+    std::shared_ptr<Go::SplineSurface> srf;
 };
 
 #endif /* SURFACE_H */
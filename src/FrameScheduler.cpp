@@ -0,0 +1,107 @@
+/*
+ * Copyright (C) 2014 SINTEF ICT,
+ * Applied Mathematics, Norway.
+ *
+ * Contact information:
+ * E-mail: eivind.fonn@sintef.no
+ * SINTEF ICT, Department of Applied Mathematics,
+ * P.O. Box 4760 Sluppen,
+ * 7045 Trondheim, Norway.
+ *
+ * This file is part of BSGUI.
+ *
+ * BSGUI is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * BSGUI is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public
+ * License along with GoTools. If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In accordance with Section 7(b) of the GNU Affero General Public
+ * License, a covered work must retain the producer line in every data
+ * file that is created or manipulated using GoTools.
+ *
+ * Other Usage
+ * You can be released from the requirements of the license by purchasing
+ * a commercial license. Buying such a license is mandatory as soon as you
+ * develop commercial activities involving the GoTools library without
+ * disclosing the source code of your own applications.
+ *
+ * This file may be used in accordance with the terms contained in a
+ * written agreement between you and SINTEF ICT.
+ */
+
+#include <algorithm>
+#include <cmath>
+
+#include "FrameScheduler.h"
+
+
+FrameScheduler::FrameScheduler(QObject *parent)
+    : QObject(parent)
+    , timer(this)
+    , interval(0)
+    , _dirty(0)
+    , _requested(0)
+    , _rendered(0)
+{
+    timer.setSingleShot(true);
+    setRefreshRate(FRAMESCHEDULER_DEFAULT_RATE);
+
+    QObject::connect(&timer, &QTimer::timeout, this, &FrameScheduler::tick);
+}
+
+
+void FrameScheduler::setRefreshRate(double rate)
+{
+    if (rate <= 0.0)
+        rate = FRAMESCHEDULER_DEFAULT_RATE;
+    interval = (int) std::floor(1000.0 / rate);
+}
+
+
+void FrameScheduler::invalidate(uint layers)
+{
+    _dirty |= layers;
+    if (!(layers & (FL_SCENE | FL_OVERLAY)))
+        return;
+
+    _requested++;
+    if (timer.isActive())
+        return;
+
+    qint64 wait = sinceFrame.isValid() ? interval - sinceFrame.elapsed() : 0;
+    timer.start((int) std::max(wait, (qint64) 0));
+}
+
+
+uint FrameScheduler::beginFrame()
+{
+    sinceFrame.start();
+    _rendered++;
+
+    uint layers = _dirty;
+    _dirty &= ~(FL_SCENE | FL_OVERLAY);
+    return layers;
+}
+
+
+void FrameScheduler::clean(uint layers)
+{
+    _dirty &= ~layers;
+}
+
+
+void FrameScheduler::tick()
+{
+    // A frame drawn for other reasons may already have covered the invalidations
+    if (_dirty & (FL_SCENE | FL_OVERLAY))
+        emit frameDue();
+}
@@ -0,0 +1,110 @@
+/*
+ * Copyright (C) 2014 SINTEF ICT,
+ * Applied Mathematics, Norway.
+ *
+ * Contact information:
+ * E-mail: eivind.fonn@sintef.no
+ * SINTEF ICT, Department of Applied Mathematics,
+ * P.O. Box 4760 Sluppen,
+ * 7045 Trondheim, Norway.
+ *
+ * This file is part of BSGUI.
+ *
+ * BSGUI is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * BSGUI is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public
+ * License along with GoTools. If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In accordance with Section 7(b) of the GNU Affero General Public
+ * License, a covered work must retain the producer line in every data
+ * file that is created or manipulated using GoTools.
+ *
+ * Other Usage
+ * You can be released from the requirements of the license by purchasing
+ * a commercial license. Buying such a license is mandatory as soon as you
+ * develop commercial activities involving the GoTools library without
+ * disclosing the source code of your own applications.
+ *
+ * This file may be used in accordance with the terms contained in a
+ * written agreement between you and SINTEF ICT.
+ */
+
+#include <QElapsedTimer>
+#include <QObject>
+#include <QTimer>
+
+#ifndef _FRAMESCHEDULER_H_
+#define _FRAMESCHEDULER_H_
+
+//! The default display refresh rate, used when the screen doesn't report one.
+#define FRAMESCHEDULER_DEFAULT_RATE 60.0
+
+typedef unsigned int uint;
+
+//! \brief Layers of a frame that can be invalidated separately (see FrameScheduler).
+//!
+//! The scene is the objects, the overlay is everything drawn on top (axes, selection rectangle)
+//! and picking is the picking buffer, which is only drawn when needed.
+enum FrameLayer { FL_SCENE = 1, FL_OVERLAY = 2, FL_PICKING = 4, FL_ALL = 7 };
+
+//! \brief Coalesces repaint requests into at most one frame per display refresh.
+//!
+//! Anything that changes what is on screen calls invalidate() with the affected layers, instead
+//! of requesting a repaint directly. The first invalidation after a frame schedules the next one
+//! for one refresh interval after the last, and later invalidations only add to the dirty layers.
+//! When the time comes, frameDue() is emitted, and the widget should repaint and call beginFrame().
+class FrameScheduler : public QObject
+{
+    Q_OBJECT
+
+public:
+    FrameScheduler(QObject *parent = NULL);
+
+    //! Sets the display refresh rate in Hz, which limits the frame rate.
+    void setRefreshRate(double rate);
+
+    //! \brief Marks layers as dirty. Schedules a frame if the scene or the overlay is dirty and no
+    //! frame is scheduled already.
+    void invalidate(uint layers);
+
+    //! \brief To be called at the start of each frame, also those not requested through
+    //! invalidate(). Clears the scene and overlay layers.
+    //! \return The layers that were dirty.
+    uint beginFrame();
+
+    //! Clears dirty layers, e.g. #FL_PICKING after drawing the picking buffer.
+    void clean(uint layers);
+
+    //! Returns the dirty layers.
+    inline uint dirty() { return _dirty; }
+
+    //! Returns the number of invalidations that asked for a frame.
+    inline uint requestedFrames() { return _requested; }
+
+    //! Returns the number of frames drawn.
+    inline uint renderedFrames() { return _rendered; }
+
+signals:
+    //! Emitted when a scheduled frame is due.
+    void frameDue();
+
+private slots:
+    void tick();
+
+private:
+    QTimer timer;
+    QElapsedTimer sinceFrame;
+    int interval;
+    uint _dirty, _requested, _rendered;
+};
+
+#endif /* _FRAMESCHEDULER_H_ */
@@ -0,0 +1,163 @@
+/*
+ * Copyright (C) 2014 SINTEF ICT,
+ * Applied Mathematics, Norway.
+ *
+ * Contact information:
+ * E-mail: eivind.fonn@sintef.no
+ * SINTEF ICT, Department of Applied Mathematics,
+ * P.O. Box 4760 Sluppen,
+ * 7045 Trondheim, Norway.
+ *
+ * This file is part of BSGUI.
+ *
+ * BSGUI is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * BSGUI is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public
+ * License along with GoTools. If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In accordance with Section 7(b) of the GNU Affero General Public
+ * License, a covered work must retain the producer line in every data
+ * file that is created or manipulated using GoTools.
+ *
+ * Other Usage
+ * You can be released from the requirements of the license by purchasing
+ * a commercial license. Buying such a license is mandatory as soon as you
+ * develop commercial activities involving the GoTools library without
+ * disclosing the source code of your own applications.
+ *
+ * This file may be used in accordance with the terms contained in a
+ * written agreement between you and SINTEF ICT.
+ */
+
+#include <algorithm>
+
+#include "Frustum.h"
+
+
+Frustum::Frustum(const QMatrix4x4 &mvp)
+{
+    QVector4D x = mvp.row(0), y = mvp.row(1), z = mvp.row(2), w = mvp.row(3);
+
+    planes[0] = w + x;
+    planes[1] = w - x;
+    planes[2] = w + y;
+    planes[3] = w - y;
+    planes[4] = w + z;
+    planes[5] = w - z;
+
+    for (auto &p : planes)
+    {
+        float length = p.toVector3D().length();
+        if (length > 0.0)
+            p = p / length;
+    }
+}
+
+
+Containment Frustum::classify(const QVector3D &center, float radius) const
+{
+    Containment ret = CT_INSIDE;
+    for (auto &p : planes)
+    {
+        float d = QVector3D::dotProduct(p.toVector3D(), center) + p.w();
+        if (d < -radius)
+            return CT_OUTSIDE;
+        if (d < radius)
+            ret = CT_INTERSECTS;
+    }
+    return ret;
+}
+
+
+bool Frustum::touchesNear(const QVector3D &center, float radius) const
+{
+    return QVector3D::dotProduct(planes[4].toVector3D(), center) + planes[4].w() < radius;
+}
+
+
+Containment Frustum::classify(const QVector3D &lo, const QVector3D &hi) const
+{
+    Containment ret = CT_INSIDE;
+    for (auto &p : planes)
+    {
+        // The corners farthest along and against the normal
+        QVector3D pos(p.x() >= 0 ? hi.x() : lo.x(), p.y() >= 0 ? hi.y() : lo.y(), p.z() >= 0 ? hi.z() : lo.z());
+        QVector3D neg(p.x() >= 0 ? lo.x() : hi.x(), p.y() >= 0 ? lo.y() : hi.y(), p.z() >= 0 ? lo.z() : hi.z());
+
+        if (QVector3D::dotProduct(p.toVector3D(), pos) + p.w() < 0)
+            return CT_OUTSIDE;
+        if (QVector3D::dotProduct(p.toVector3D(), neg) + p.w() < 0)
+            ret = CT_INTERSECTS;
+    }
+    return ret;
+}
+
+
+bool Frustum::intersects(const QVector3D &a, const QVector3D &b) const
+{
+    // Clip the parameter interval against each plane in turn
+    float t0 = 0.0, t1 = 1.0;
+    for (auto &p : planes)
+    {
+        float da = distance(p, a), db = distance(p, b);
+        if (da < 0 && db < 0)
+            return false;
+        if (da < 0)
+            t0 = std::max(t0, da / (da - db));
+        else if (db < 0)
+            t1 = std::min(t1, da / (da - db));
+        if (t0 > t1)
+            return false;
+    }
+    return true;
+}
+
+
+bool Frustum::intersects(const QVector3D &a, const QVector3D &b, const QVector3D &c) const
+{
+    // Sutherland-Hodgman clipping, where each plane adds at most one vertex
+    QVector3D buffers[2][9] = { { a, b, c } };
+    float d[9];
+    uint n = 3, cur = 0;
+
+    for (auto &p : planes)
+    {
+        const QVector3D *in = buffers[cur];
+        QVector3D *out = buffers[1 - cur];
+
+        bool anyIn = false, anyOut = false;
+        for (uint i = 0; i < n; i++)
+        {
+            d[i] = distance(p, in[i]);
+            if (d[i] < 0)
+                anyOut = true;
+            else
+                anyIn = true;
+        }
+        if (!anyIn)
+            return false;
+        if (!anyOut)
+            continue;
+
+        uint m = 0;
+        for (uint i = 0, j = n - 1; i < n; j = i++)
+        {
+            if ((d[j] < 0) != (d[i] < 0))
+                out[m++] = in[j] + (in[i] - in[j]) * (d[j] / (d[j] - d[i]));
+            if (d[i] >= 0)
+                out[m++] = in[i];
+        }
+        n = m;
+        cur = 1 - cur;
+    }
+    return true;
+}
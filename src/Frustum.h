@@ -0,0 +1,92 @@
+/*
+ * Copyright (C) 2014 SINTEF ICT,
+ * Applied Mathematics, Norway.
+ *
+ * Contact information:
+ * E-mail: eivind.fonn@sintef.no
+ * SINTEF ICT, Department of Applied Mathematics,
+ * P.O. Box 4760 Sluppen,
+ * 7045 Trondheim, Norway.
+ *
+ * This file is part of BSGUI.
+ *
+ * BSGUI is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * BSGUI is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public
+ * License along with GoTools. If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In accordance with Section 7(b) of the GNU Affero General Public
+ * License, a covered work must retain the producer line in every data
+ * file that is created or manipulated using GoTools.
+ *
+ * Other Usage
+ * You can be released from the requirements of the license by purchasing
+ * a commercial license. Buying such a license is mandatory as soon as you
+ * develop commercial activities involving the GoTools library without
+ * disclosing the source code of your own applications.
+ *
+ * This file may be used in accordance with the terms contained in a
+ * written agreement between you and SINTEF ICT.
+ */
+
+#include <QMatrix4x4>
+#include <QVector3D>
+#include <QVector4D>
+
+#ifndef _FRUSTUM_H_
+#define _FRUSTUM_H_
+
+//! The result of testing a bounding volume against a Frustum.
+enum Containment { CT_OUTSIDE, CT_INTERSECTS, CT_INSIDE };
+
+//! \brief The view frustum of a model-view-projection matrix, as six planes in model space.
+//!
+//! The planes are extracted from the rows of the matrix, so the frustum of any sub-rectangle of
+//! the viewport can be had by premultiplying with a matrix mapping that rectangle to the whole
+//! clip space. The tests are conservative: a volume classified as outside is guaranteed to be
+//! invisible, but volumes near the corners may be classified as intersecting although they are
+//! not.
+class Frustum
+{
+public:
+    //! Constructs the frustum of the given model-view-projection matrix.
+    Frustum(const QMatrix4x4 &mvp);
+
+    //! Classifies a sphere.
+    Containment classify(const QVector3D &center, float radius) const;
+
+    //! Classifies an axis-aligned box with corners \a lo and \a hi.
+    Containment classify(const QVector3D &lo, const QVector3D &hi) const;
+
+    //! Check whether a sphere reaches the near plane or behind it.
+    bool touchesNear(const QVector3D &center, float radius) const;
+
+    //! \brief Check whether the segment from \a a to \a b reaches into the frustum. Unlike the
+    //! classifications, this test is exact.
+    bool intersects(const QVector3D &a, const QVector3D &b) const;
+
+    //! \brief Check whether the triangle \a a, \a b, \a c reaches into the frustum. Unlike the
+    //! classifications, this test is exact.
+    bool intersects(const QVector3D &a, const QVector3D &b, const QVector3D &c) const;
+
+private:
+    //! The planes, with normals pointing into the frustum.
+    QVector4D planes[6];
+
+    //! The signed distance from a plane to a point, positive inside.
+    inline static float distance(const QVector4D &p, const QVector3D &v)
+    {
+        return QVector3D::dotProduct(p.toVector3D(), v) + p.w();
+    }
+};
+
+#endif /* _FRUSTUM_H_ */
@@ -40,12 +40,19 @@
 
 #include <algorithm>
 #include <cmath>
+#include <cstdint>
 #include <set>
+#include <vector>
 #include <QFile>
 #include <QTextStream>
 #include <QRect>
 #include <QDesktopWidget>
+#include <QElapsedTimer>
+#include <QGuiApplication>
+#include <QScreen>
 #include <QSettings>
+#include <QOpenGLContext>
+#include <QOpenGLFunctions_3_2_Core>
 
 #include "DisplayObject.h"
 
@@ -53,11 +60,25 @@
 
 GLWidget::GLWidget(ObjectSet *oSet, QWidget *parent, QSettings *settings)
     : QGLWidget(parent)
-    , vcProgram(), ccProgram()
+    , vcProgram(), ccProgram(), sceneProgram(), pickProgram()
+    , ccLineProgram(), pickLineProgram()
+    , vao()
+    , sceneBuffer(NULL)
+    , sceneTexture(NULL)
+    , pickBuffer(0)
+    , pickPixels(0)
+    , pickFence(0)
+    , hoverPixels(0)
+    , hoverFence(0)
+    , hoverPos(-1, -1)
+    , hoverRead(-1, -1)
+    , hovered(PICK_NONE, 0)
     , auxBuffer(QOpenGLBuffer::VertexBuffer)
     , axesBuffer(QOpenGLBuffer::IndexBuffer)
     , selectionBuffer(QOpenGLBuffer::IndexBuffer)
     , auxCBuffer(QOpenGLBuffer::VertexBuffer)
+    , cameraBuffer(QOpenGLBuffer::VertexBuffer)
+    , lassoBuffer(QOpenGLBuffer::VertexBuffer)
     , objectSet(oSet)
     , shiftPressed(false)
     , ctrlPressed(false)
@@ -76,22 +97,73 @@ GLWidget::GLWidget(ObjectSet *oSet, QWidget *parent, QSettings *settings)
     , _showAxes(true)
     , _showPoints(false)
     , _diameter(20.0)
+    , _drawCalls(0)
+    , _culledPatches(0)
+    , _occludedPatches(0)
+    , _culledPicks(0)
+    , scheduler(this)
+    , rayPicker(this)
+    , _rayPicking(settings ? settings->value("picking/rays").toBool() : false)
+    , _xraySelection(settings ? settings->value("picking/xray").toBool() : false)
     , selectTracking(false)
     , cameraTracking(false)
     , _settings(settings)
 {
     installEventFilter(parent);
     setFocusPolicy(Qt::ClickFocus);
+    if (QGuiApplication::primaryScreen())
+        scheduler.setRefreshRate(QGuiApplication::primaryScreen()->refreshRate());
+    if (settings)
+    {
+        DisplayObject::setCompact(settings->value("display/compact").toBool());
+        DisplayObject::setLowMemory(settings->value("display/lowMemory").toBool());
+        DisplayObject::setOcclusionCulling(settings->value("display/occlusionCulling", true).toBool());
+    }
     QObject::connect(oSet, &ObjectSet::requestInitialization, this, &GLWidget::initializeDispObject);
-    QObject::connect(oSet, SIGNAL(update()), this, SLOT(update()));
-    QObject::connect(oSet, SIGNAL(selectionChanged()), this, SLOT(update()));
+    QObject::connect(oSet, &ObjectSet::tessellationReady, this, &GLWidget::uploadTessellations);
+    QObject::connect(oSet, SIGNAL(update()), this, SLOT(objectsChanged()));
+    QObject::connect(oSet, SIGNAL(selectionChanged()), this, SLOT(selectionChanged()));
+    QObject::connect(&scheduler, SIGNAL(frameDue()), this, SLOT(update()));
+
+    readbackTimer.setInterval(1);
+    QObject::connect(&readbackTimer, SIGNAL(timeout()), this, SLOT(readPicks()));
+    QObject::connect(&rayPicker, SIGNAL(finished()), this, SLOT(readRayPicks()));
+
+    QObject::connect(oSet, SIGNAL(selectionModeChanged(SelectionMode)), this, SLOT(objectsChanged()));
+    setMouseTracking(true);
 }
 
 
 GLWidget::~GLWidget()
 {
   if (_settings)
+  {
     _settings->setValue("camera/perspective", _perspective);
+    _settings->setValue("display/compact", compactBuffers());
+    _settings->setValue("display/lowMemory", lowMemory());
+    _settings->setValue("display/occlusionCulling", occlusionCulling());
+    _settings->setValue("picking/rays", _rayPicking);
+    _settings->setValue("picking/xray", _xraySelection);
+  }
+
+  makeCurrent();
+  delete sceneBuffer;
+  delete sceneTexture;
+
+  QOpenGLFunctions_3_2_Core *gl = QOpenGLContext::currentContext()->versionFunctions<QOpenGLFunctions_3_2_Core>();
+  if (pickBuffer)
+  {
+      gl->glDeleteFramebuffers(1, &pickBuffer);
+      gl->glDeleteRenderbuffers(2, pickRenderbuffers);
+  }
+  if (pickPixels)
+      gl->glDeleteBuffers(1, &pickPixels);
+  if (pickFence)
+      gl->glDeleteSync(pickFence);
+  if (hoverPixels)
+      gl->glDeleteBuffers(1, &hoverPixels);
+  if (hoverFence)
+      gl->glDeleteSync(hoverFence);
 }
 
 
@@ -121,62 +193,251 @@ void GLWidget::centerOnSelected()
         setZoom(1.0);
     }
 
-    update();
+    scheduler.invalidate(FL_ALL);
 }
 
 
-std::set<std::pair<uint,uint>> GLWidget::paintGLPicks(int x, int y, int w, int h)
+void GLWidget::drawPickBuffer()
 {
-    glClearColor(1.0, 1.0, 1.0, 1.0);
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    QOpenGLFunctions_3_2_Core *gl = QOpenGLContext::currentContext()->versionFunctions<QOpenGLFunctions_3_2_Core>();
+
+    // The buffer is kept between picks, and only drawn again when the picking layer is dirty
+    if (!bindPickBuffer() && !(scheduler.dirty() & FL_PICKING))
+        return;
+
+    GLuint none[4] = {PICK_NONE, 0, 0, 0};
+    gl->glClearBufferuiv(GL_COLOR, 0, none);
+    glClear(GL_DEPTH_BUFFER_BIT);
 
-    glDisable(GL_POINT_SMOOTH);
     glDisable(GL_LINE_SMOOTH);
-    glDisable(GL_MULTISAMPLE);
+    glDisable(GL_BLEND);
 
     QMatrix4x4 mvp;
     matrix(&mvp);
+    setCamera(mvp);
+
+    DisplayObject::bindArena(pickProgram);
+    SelectionMode mode = objectSet->selectionMode();
+    _culledPicks = DisplayObject::cull(Frustum(mvp), [this, mode] (DisplayObject *obj, bool inside) {
+        obj->drawPicking(pickProgram, mode);
+    });
+    vao.bind();
+
+    glEnable(GL_BLEND);
+    glEnable(GL_LINE_SMOOTH);
+
+    scheduler.clean(FL_PICKING);
+}
+
+
+void GLWidget::paintGLPicks(int x, int y, int w, int h)
+{
+    QOpenGLFunctions_3_2_Core *gl = QOpenGLContext::currentContext()->versionFunctions<QOpenGLFunctions_3_2_Core>();
+
+    drawPickBuffer();
+
+    // Copy the pixels into a buffer object, so that the GPU finishes in the background. A pick
+    // still in flight is superseded.
+    if (!pickPixels)
+        gl->glGenBuffers(1, &pickPixels);
+    if (pickFence)
+        gl->glDeleteSync(pickFence);
+
+    gl->glBindBuffer(GL_PIXEL_PACK_BUFFER, pickPixels);
+    gl->glBufferData(GL_PIXEL_PACK_BUFFER, 2 * w * h * sizeof(GLuint), NULL, GL_STREAM_READ);
+    glReadPixels(x, y, w, h, GL_RG_INTEGER, GL_UNSIGNED_INT, 0);
+    gl->glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    pickFence = gl->glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    pickX = x;
+    pickY = y;
+    pickWidth = w;
+    pickHeight = h;
+    glFlush();
+
+    gl->glBindFramebuffer(GL_FRAMEBUFFER, QOpenGLContext::currentContext()->defaultFramebufferObject());
+}
+
+
+void GLWidget::updateHover()
+{
+    QOpenGLFunctions_3_2_Core *gl = QOpenGLContext::currentContext()->versionFunctions<QOpenGLFunctions_3_2_Core>();
+
+    if (hoverFence)
+    {
+        // Check again next frame
+        if (gl->glClientWaitSync(hoverFence, 0, 0) == GL_TIMEOUT_EXPIRED)
+        {
+            scheduler.invalidate(FL_OVERLAY);
+            return;
+        }
+
+        gl->glDeleteSync(hoverFence);
+        hoverFence = 0;
+
+        GLuint pixel[2];
+        gl->glBindBuffer(GL_PIXEL_PACK_BUFFER, hoverPixels);
+        gl->glGetBufferSubData(GL_PIXEL_PACK_BUFFER, 0, sizeof(pixel), pixel);
+        gl->glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+        // This frame draws the new highlight already, unless the hover was cleared or the
+        // picking layer has changed since the read
+        if (hoverPos.x() >= 0 && hoverRead.x() >= 0)
+            hovered = std::make_pair(pixel[0], pixel[1]);
+    }
+
+    // Read the pixel under the cursor, if it has moved since the last read
+    if (hoverPos != hoverRead && hoverPos.x() >= 0 && hoverPos.x() < width() &&
+        hoverPos.y() >= 0 && hoverPos.y() < height())
+    {
+        drawPickBuffer();
+
+        if (!hoverPixels)
+        {
+            gl->glGenBuffers(1, &hoverPixels);
+            gl->glBindBuffer(GL_PIXEL_PACK_BUFFER, hoverPixels);
+            gl->glBufferData(GL_PIXEL_PACK_BUFFER, 2 * sizeof(GLuint), NULL, GL_STREAM_READ);
+        }
+        gl->glBindBuffer(GL_PIXEL_PACK_BUFFER, hoverPixels);
+        glReadPixels(hoverPos.x(), height() - 1 - hoverPos.y(), 1, 1, GL_RG_INTEGER, GL_UNSIGNED_INT, 0);
+        gl->glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+        hoverFence = gl->glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        hoverRead = hoverPos;
+        glFlush();
+
+        gl->glBindFramebuffer(GL_FRAMEBUFFER, QOpenGLContext::currentContext()->defaultFramebufferObject());
+        scheduler.invalidate(FL_OVERLAY);
+    }
+}
 
-    for (auto i = DisplayObject::begin(); i != DisplayObject::end(); i++)
-        i->second->drawPicking(mvp, ccProgram, objectSet->selectionMode());
 
-    GLubyte pixels[4 * w * h];
-    glReadPixels(x, y, w, h, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+void GLWidget::clearHover()
+{
+    hoverRead = hoverPos = QPoint(-1, -1);
+    if (hovered.first != PICK_NONE)
+    {
+        hovered = std::make_pair(PICK_NONE, 0u);
+        scheduler.invalidate(FL_OVERLAY);
+    }
+}
+
 
-    std::unordered_map<uint, uint> picks;
-    for (int i = 0; i < w * h; i++)
+//! \brief Appends the runs of equal (index, offset) pairs among \a n pixels of the picking
+//! buffer, skipping #PICK_NONE.
+//!
+//! The buffer is mostly long runs of the same pair, so they are collapsed in one linear pass, and
+//! only the runs are sorted and merged by pickHistogram().
+static void pickRuns(const uint64_t *pixels, size_t n, std::vector<std::pair<uint64_t,uint>> *runs)
+{
+    size_t i = 0;
+    while (i < n)
     {
-        uint key = DisplayObject::colorToKey(&pixels[4*i]);
+        uint64_t key = pixels[i];
+        size_t j = i + 1;
+        while (j < n && pixels[j] == key)
+            j++;
+        if ((GLuint) key != PICK_NONE)
+            runs->push_back(std::make_pair(key, (uint) (j - i)));
+        i = j;
+    }
+}
+
 
-        if (picks.find(key) != picks.end())
-            picks[key]++;
+//! Counts the distinct (index, offset) pairs among runs from pickRuns().
+static void pickHistogram(std::vector<std::pair<uint64_t,uint>> &runs, std::vector<std::pair<uint64_t,uint>> *counts)
+{
+    std::sort(runs.begin(), runs.end());
+
+    counts->clear();
+    for (auto &r : runs)
+    {
+        if (!counts->empty() && counts->back().first == r.first)
+            counts->back().second += r.second;
         else
-            picks[key] = 1;
+            counts->push_back(r);
     }
+}
 
-    std::set<uint> deletes;
 
-    int limit = std::min(std::min(w, h) - 1, 2);
-    for (auto p : picks)
-        if (p.second < limit || p.first == WHITE_KEY)
-            deletes.insert(p.first);
+//! \brief Finds the spans of a row of pixels that are inside a polygon, by the even-odd rule.
+//!
+//! \param polygon The corners, in widget coordinates.
+//! \param y The vertical widget coordinate of the pixel centers of the row.
+//! \param x The first column of the row.
+//! \param w The number of columns of the row.
+//! \param crossings Scratch space, reused between rows.
+//! \retval spans The half-open ranges of columns inside, relative to \a x.
+static void maskSpans(const std::vector<QPoint> &polygon, double y, int x, int w,
+                      std::vector<double> *crossings, std::vector<std::pair<int,int>> *spans)
+{
+    crossings->clear();
+    for (size_t i = 0, j = polygon.size() - 1; i < polygon.size(); j = i++)
+    {
+        const QPoint &p = polygon[i], &q = polygon[j];
+        if ((p.y() <= y) != (q.y() <= y))
+            crossings->push_back(p.x() + (y - p.y()) * (q.x() - p.x()) / (q.y() - p.y()));
+    }
+    std::sort(crossings->begin(), crossings->end());
 
-    for (auto p : deletes)
-        picks.erase(p);
-    
-    std::set<std::pair<uint,uint>> ret;
-    for (auto p : picks)
+    // A pixel is inside if its center is
+    spans->clear();
+    for (size_t i = 0; i + 1 < crossings->size(); i += 2)
     {
-        uint index, offset;
-        DisplayObject::keyToIndex(p.first, &index, &offset);
-        ret.insert(std::pair<uint,uint>(index, offset));
+        int from = std::max((int) std::ceil((*crossings)[i] - 0.5) - x, 0);
+        int to = std::min((int) std::ceil((*crossings)[i+1] - 0.5) - x, w);
+        if (from < to)
+            spans->push_back(std::make_pair(from, to));
     }
+}
 
-    glEnable(GL_MULTISAMPLE);
-    glEnable(GL_LINE_SMOOTH);
-    glEnable(GL_POINT_SMOOTH);
 
-    return ret;
+bool GLWidget::collectPicks(std::set<std::pair<uint,uint>> *picks)
+{
+    QOpenGLFunctions_3_2_Core *gl = QOpenGLContext::currentContext()->versionFunctions<QOpenGLFunctions_3_2_Core>();
+
+    if (!pickFence)
+        return true;
+    if (gl->glClientWaitSync(pickFence, 0, 0) == GL_TIMEOUT_EXPIRED)
+        return false;
+
+    gl->glDeleteSync(pickFence);
+    pickFence = 0;
+
+    size_t n = (size_t) pickWidth * pickHeight;
+    gl->glBindBuffer(GL_PIXEL_PACK_BUFFER, pickPixels);
+    const uint64_t *pixels = (const uint64_t *)
+        gl->glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, n * 2 * sizeof(GLuint), GL_MAP_READ_BIT);
+
+    // Each pixel is the pair (index, offset), with the index in the low word. With a lasso, only
+    // the spans of each row inside it are counted.
+    std::vector<std::pair<uint64_t,uint>> runs;
+    if (pixels && pickMask.empty())
+        pickRuns(pixels, n, &runs);
+    else if (pixels)
+    {
+        std::vector<double> crossings;
+        std::vector<std::pair<int,int>> spans;
+        for (int r = 0; r < pickHeight; r++)
+        {
+            maskSpans(pickMask, height() - pickY - r - 0.5, pickX, pickWidth, &crossings, &spans);
+            for (auto &s : spans)
+                pickRuns(pixels + (size_t) r * pickWidth + s.first, s.second - s.first, &runs);
+        }
+    }
+
+    gl->glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    gl->glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    std::vector<std::pair<uint64_t,uint>> counts;
+    pickHistogram(runs, &counts);
+
+    int limit = std::min(std::min(pickWidth, pickHeight) - 1, 2);
+    for (auto &c : counts)
+        if (c.second >= limit)
+            picks->insert(std::make_pair((uint) (c.first & 0xFFFFFFFF), (uint) (c.first >> 32)));
+
+    return true;
 }
 
 
@@ -184,29 +445,61 @@ void GLWidget::paintGL()
 {
     std::lock(m, DisplayObject::m);
 
-    glClearColor(1.0, 1.0, 1.0, 1.0);
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    uint layers = scheduler.beginFrame();
 
-    QMatrix4x4 mvp;
-    matrix(&mvp);
+    if (!sceneBuffer || sceneBuffer->size() != QSize(width(), height()))
+    {
+        delete sceneBuffer;
+        delete sceneTexture;
 
-    for (auto i = DisplayObject::begin(); i != DisplayObject::end(); i++)
-        i->second->draw(mvp, ccProgram, _showPoints || objectSet->selectionMode() == SM_POINT);
+        QOpenGLFramebufferObjectFormat fmt;
+        fmt.setSamples(std::max(format().samples(), 0));
+        fmt.setAttachment(QOpenGLFramebufferObject::Depth);
+        sceneBuffer = new QOpenGLFramebufferObject(QSize(width(), height()), fmt);
+        sceneTexture = new QOpenGLFramebufferObject(QSize(width(), height()));
 
-    if (_showAxes)
+        layers |= FL_SCENE;
+    }
+
+    if (layers & FL_SCENE)
+        drawScene();
+
+    // Whatever was under the cursor may have moved, so read it again
+    if (layers & FL_PICKING)
     {
-        glDisable(GL_DEPTH_TEST);
-        drawAxes();
-        glEnable(GL_DEPTH_TEST);
+        hoverRead = QPoint(-1, -1);
+        hovered = std::make_pair(PICK_NONE, 0u);
     }
+    if (!cameraTracking)
+        updateHover();
+
+    // Composite the cached scene, then the overlays on top
+    glDisable(GL_DEPTH_TEST);
+    glDisable(GL_BLEND);
+    sceneProgram.bind();
+    glBindTexture(GL_TEXTURE_2D, sceneTexture->texture());
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+    glEnable(GL_BLEND);
 
-    if (selectTracking)
+    DisplayObject *hoverObject = DisplayObject::getObject(hovered.first);
+    if (hoverObject && !selectTracking)
     {
-        glDisable(GL_DEPTH_TEST);
-        drawSelection();
-        glEnable(GL_DEPTH_TEST);
+        QMatrix4x4 mvp;
+        matrix(&mvp);
+        setCamera(mvp);
+        DisplayObject::bindArena(ccProgram);
+        hoverObject->drawHover(ccProgram, objectSet->selectionMode(), hovered.second);
+        vao.bind();
     }
 
+    if (_showAxes)
+        drawAxes();
+
+    if (selectTracking)
+        drawSelection();
+
+    glEnable(GL_DEPTH_TEST);
+
     swapBuffers();
 
     m.unlock();
@@ -214,6 +507,53 @@ void GLWidget::paintGL()
 }
 
 
+void GLWidget::drawScene()
+{
+    sceneBuffer->bind();
+
+    glClearColor(1.0, 1.0, 1.0, 1.0);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+    QMatrix4x4 mvp;
+    matrix(&mvp);
+    setCamera(mvp);
+
+    _drawCalls = DisplayObject::drawAll(ccProgram, Frustum(mvp),
+                                        _showPoints || objectSet->selectionMode() == SM_POINT,
+                                        &_culledPatches, &_occludedPatches);
+    vao.bind();
+
+    sceneBuffer->release();
+    QOpenGLFramebufferObject::blitFramebuffer(sceneTexture, sceneBuffer);
+}
+
+
+bool GLWidget::bindPickBuffer()
+{
+    QOpenGLFunctions_3_2_Core *gl = QOpenGLContext::currentContext()->versionFunctions<QOpenGLFunctions_3_2_Core>();
+
+    if (!pickBuffer)
+    {
+        gl->glGenFramebuffers(1, &pickBuffer);
+        gl->glGenRenderbuffers(2, pickRenderbuffers);
+    }
+    gl->glBindFramebuffer(GL_FRAMEBUFFER, pickBuffer);
+
+    if (pickSize == QSize(width(), height()))
+        return false;
+    pickSize = QSize(width(), height());
+
+    gl->glBindRenderbuffer(GL_RENDERBUFFER, pickRenderbuffers[0]);
+    gl->glRenderbufferStorage(GL_RENDERBUFFER, GL_RG32UI, width(), height());
+    gl->glBindRenderbuffer(GL_RENDERBUFFER, pickRenderbuffers[1]);
+    gl->glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width(), height());
+
+    gl->glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, pickRenderbuffers[0]);
+    gl->glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, pickRenderbuffers[1]);
+    return true;
+}
+
+
 void GLWidget::drawAxes()
 {
     vcProgram.bind();
@@ -231,7 +571,7 @@ void GLWidget::drawAxes()
     vcProgram.setUniformValue("mvp", mvp);
 
     axesBuffer.bind();
-    glLineWidth(3.0);
+    glLineWidth(std::min(3.0f, lineWidthRange[1]));
     glDrawElements(GL_LINES, 2 * 3, GL_UNSIGNED_INT, 0);
 }
 
@@ -241,30 +581,65 @@ void GLWidget::drawSelection()
     glDisable(GL_LINE_SMOOTH);
 
     ccProgram.bind();
-
-    auxBuffer.bind();
-    ccProgram.enableAttributeArray("vertexPosition");
-    ccProgram.setAttributeBuffer("vertexPosition", GL_FLOAT, 0, 3);
+    ccProgram.setUniformValue("col", QVector4D(0,0,0,0.6));
+    ccProgram.setUniformValue("compact", (GLint) 0);
+    glLineWidth(1.0);
 
     QMatrix4x4 mvp;
     mvp.setToIdentity();
 
+    if (!lasso.empty())
+    {
+        // The corners so far, and the cursor, in normalized device coordinates
+        std::vector<QVector3D> corners;
+        for (auto &p : lasso)
+            corners.push_back(QVector3D((float) p.x()/width() * 2.0 - 1.0,
+                                        1.0 - (float) p.y()/height() * 2.0, 0.0));
+        corners.push_back(QVector3D((float) selectTo.x()/width() * 2.0 - 1.0,
+                                    1.0 - (float) selectTo.y()/height() * 2.0, 0.0));
+
+        lassoBuffer.bind();
+        lassoBuffer.allocate(&corners[0], corners.size() * 3 * sizeof(float));
+        ccProgram.enableAttributeArray(ATTRIBUTE_POSITION);
+        ccProgram.setAttributeBuffer(ATTRIBUTE_POSITION, GL_FLOAT, 0, 3);
+        setCamera(mvp);
+
+        glDrawArrays(GL_LINE_LOOP, 0, corners.size());
+
+        glEnable(GL_LINE_SMOOTH);
+        return;
+    }
+
+    auxBuffer.bind();
+    ccProgram.enableAttributeArray(ATTRIBUTE_POSITION);
+    ccProgram.setAttributeBuffer(ATTRIBUTE_POSITION, GL_FLOAT, 0, 3);
+
     QPoint d = selectTo - selectOrig;
     mvp.translate((float) selectOrig.x()/width() * 2.0 - 1.0,
                   1.0 - (float) selectOrig.y()/height() * 2.0, 0.0);
     mvp.scale((float) d.x()/width()*2.0, - (float) d.y()/height()*2.0, 1.0);
-    ccProgram.setUniformValue("mvp", mvp);
-
-    ccProgram.setUniformValue("col", QVector4D(0,0,0,0.6));
+    setCamera(mvp);
 
     selectionBuffer.bind();
-    glLineWidth(1.0);
     glDrawElements(GL_LINE_LOOP, 4, GL_UNSIGNED_INT, 0);
 
     glEnable(GL_LINE_SMOOTH);
 }
 
 
+void GLWidget::setCamera(const QMatrix4x4 &mvp)
+{
+    cameraBuffer.bind();
+    cameraBuffer.write(0, mvp.constData(), 16 * sizeof(GLfloat));
+
+    // The line programs need the viewport size to widen lines in pixels
+    GLint viewport[4];
+    glGetIntegerv(GL_VIEWPORT, viewport);
+    GLfloat size[2] = { (GLfloat) viewport[2], (GLfloat) viewport[3] };
+    cameraBuffer.write(16 * sizeof(GLfloat), size, 2 * sizeof(GLfloat));
+}
+
+
 void GLWidget::resizeGL(int w, int h)
 {
     m.lock();
@@ -289,14 +664,23 @@ void GLWidget::initializeGL()
 {
     m.lock();
 
+    QOpenGLFunctions_3_2_Core *gl = QOpenGLContext::currentContext()->versionFunctions<QOpenGLFunctions_3_2_Core>();
+    if (!gl || !gl->initializeOpenGLFunctions())
+        close();
+
+    // The core profile has no default vertex array object
+    vao.create();
+    vao.bind();
+
     glEnable(GL_BLEND);
     glEnable(GL_DEPTH_TEST);
     glEnable(GL_MULTISAMPLE);
     glEnable(GL_LINE_SMOOTH);
-    glEnable(GL_POINT_SMOOTH);
+    glEnable(GL_PRIMITIVE_RESTART);
     glDepthFunc(GL_LEQUAL);
     glHint(GL_LINE_SMOOTH_HINT, GL_NICEST);
     glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    glGetFloatv(GL_ALIASED_LINE_WIDTH_RANGE, lineWidthRange);
 
 
     if (!addShader(vcProgram, QOpenGLShader::Vertex, ":/shaders/varying_vertex.glsl"))
@@ -310,9 +694,48 @@ void GLWidget::initializeGL()
         close();
     if (!addShader(ccProgram, QOpenGLShader::Fragment, ":/shaders/constant_fragment.glsl"))
         close();
-    if (!ccProgram.link())
+    if (!DisplayObject::linkProgram(ccProgram))
         close();
 
+    if (!addShader(pickProgram, QOpenGLShader::Vertex, ":/shaders/constant_vertex.glsl"))
+        close();
+    if (!addShader(pickProgram, QOpenGLShader::Fragment, ":/shaders/picking_fragment.glsl"))
+        close();
+    if (!DisplayObject::linkProgram(pickProgram, true))
+        close();
+
+    if (!addShader(ccLineProgram, QOpenGLShader::Vertex, ":/shaders/constant_vertex.glsl"))
+        close();
+    if (!addShader(ccLineProgram, QOpenGLShader::Geometry, ":/shaders/line_geometry.glsl"))
+        close();
+    if (!addShader(ccLineProgram, QOpenGLShader::Fragment, ":/shaders/constant_fragment.glsl"))
+        close();
+    if (!DisplayObject::linkProgram(ccLineProgram, false, true))
+        close();
+
+    if (!addShader(pickLineProgram, QOpenGLShader::Vertex, ":/shaders/constant_vertex.glsl"))
+        close();
+    if (!addShader(pickLineProgram, QOpenGLShader::Geometry, ":/shaders/line_geometry.glsl"))
+        close();
+    if (!addShader(pickLineProgram, QOpenGLShader::Fragment, ":/shaders/picking_fragment.glsl"))
+        close();
+    if (!DisplayObject::linkProgram(pickLineProgram, true, true))
+        close();
+
+    if (!addShader(sceneProgram, QOpenGLShader::Vertex, ":/shaders/scene_vertex.glsl"))
+        close();
+    if (!addShader(sceneProgram, QOpenGLShader::Fragment, ":/shaders/scene_fragment.glsl"))
+        close();
+    if (!sceneProgram.link())
+        close();
+
+    // The Camera uniform block, shared by all draws of a frame
+    cameraBuffer.create();
+    cameraBuffer.setUsagePattern(QOpenGLBuffer::DynamicDraw);
+    cameraBuffer.bind();
+    cameraBuffer.allocate(20 * sizeof(GLfloat));
+    gl->glBindBufferBase(GL_UNIFORM_BUFFER, CAMERA_BINDING, cameraBuffer.bufferId());
+
     std::vector<QVector3D> auxData = {
         QVector3D(0,0,0), QVector3D(1,0,0),
         QVector3D(0,0,0), QVector3D(0,1,0),
@@ -336,6 +759,9 @@ void GLWidget::initializeGL()
     selectionBuffer.bind();
     selectionBuffer.allocate(&selectionData[0], 4 * sizeof(GLuint));
 
+    lassoBuffer.create();
+    lassoBuffer.setUsagePattern(QOpenGLBuffer::DynamicDraw);
+
     std::vector<QVector3D> auxColors = {
         QVector3D(1,0,0), QVector3D(1,0,0),
         QVector3D(0,1,0), QVector3D(0,1,0),
@@ -370,7 +796,7 @@ void GLWidget::keyPressEvent(QKeyEvent *event)
         return;
     }
 
-    update();
+    scheduler.invalidate(FL_ALL);
 }
 
 
@@ -381,7 +807,11 @@ void GLWidget::keyReleaseEvent(QKeyEvent *event)
     if (event->key() == Qt::Key_Shift)
         shiftPressed = false;
     if (event->key() == Qt::Key_Alt)
+    {
         altPressed = false;
+        if (!lasso.empty())
+            finishLasso();
+    }
 }
 
 
@@ -398,6 +828,12 @@ void GLWidget::mousePressEvent(QMouseEvent *event)
     }
     else if (event->button() == Qt::LeftButton)
     {
+        // With Alt, drag a lasso, or click the corners of a polygon
+        if (altPressed)
+            lasso.push_back(event->pos());
+        else
+            lasso.clear();
+
         selectTracking = true;
         selectOrig = event->pos();
         selectTo = event->pos();
@@ -411,23 +847,129 @@ void GLWidget::mouseReleaseEvent(QMouseEvent *event)
         cameraTracking = false;
     else if (event->button() == Qt::LeftButton)
     {
-        std::lock(m, DisplayObject::m);
+        if (!lasso.empty())
+        {
+            // A click adds a corner to the polygon, which is closed by releasing Alt
+            if ((event->pos() - selectOrig).manhattanLength() > 2)
+                finishLasso();
+            return;
+        }
+
+        // Releasing Alt during the drag has closed the lasso already
+        if (!selectTracking)
+            return;
 
         selectTracking = false;
+        scheduler.invalidate(FL_OVERLAY);
 
         int x = std::max(std::min(event->pos().x(), selectOrig.x()), 0);
         int y = std::max(height() - std::max(event->pos().y(), selectOrig.y()), 0);
         int toX = std::min(std::max(event->pos().x(), selectOrig.x()), width() - 1);
         int toY = std::min(height() - std::min(event->pos().y(), selectOrig.y()), height() - 1);
+        pickClears = !ctrlPressed;
+
+        if (_xraySelection)
+        {
+            // Select through everything in the rectangle, by culling against its frustum
+            QMatrix4x4 mvp, region;
+            matrix(&mvp);
+            region.scale((float) width() / (toX - x + 1), (float) height() / (toY - y + 1), 1.0);
+            region.translate(1.0 - (2.0 * x + toX - x + 1) / width(),
+                             1.0 - (2.0 * y + toY - y + 1) / height(), 0.0);
+
+            std::set<std::pair<uint,uint>> picks;
+            DisplayObject::m.lock();
+            DisplayObject::xrayAll(Frustum(region * mvp), objectSet->selectionMode(), &picks);
+            DisplayObject::m.unlock();
+
+            objectSet->setSelection(&picks, pickClears);
+            return;
+        }
+
+        if (_rayPicking)
+        {
+            QMatrix4x4 mvp;
+            matrix(&mvp);
+            rayPicker.pick(mvp, width(), height(), x, y, toX - x + 1, toY - y + 1, objectSet->selectionMode());
+            return;
+        }
+
+        std::lock(m, DisplayObject::m);
 
         makeCurrent();
-        std::set<std::pair<uint,uint>> picks = paintGLPicks(x, y, toX - x + 1, toY - y + 1);
+        pickMask.clear();
+        paintGLPicks(x, y, toX - x + 1, toY - y + 1);
 
         m.unlock();
         DisplayObject::m.unlock();
 
-        objectSet->setSelection(&picks, !ctrlPressed);
+        readbackTimer.start();
+    }
+}
+
+
+void GLWidget::finishLasso()
+{
+    std::vector<QPoint> polygon;
+    polygon.swap(lasso);
+    selectTracking = false;
+    scheduler.invalidate(FL_OVERLAY);
+
+    if (polygon.size() < 3)
+        return;
+
+    int minX = width(), maxX = -1, minY = height(), maxY = -1;
+    for (auto &p : polygon)
+    {
+        minX = std::min(minX, p.x());
+        maxX = std::max(maxX, p.x());
+        minY = std::min(minY, p.y());
+        maxY = std::max(maxY, p.y());
     }
+
+    int x = std::max(minX, 0), toX = std::min(maxX, width() - 1);
+    int y = std::max(height() - 1 - maxY, 0), toY = std::min(height() - 1 - minY, height() - 1);
+    if (x > toX || y > toY)
+        return;
+
+    pickClears = !ctrlPressed;
+
+    // Only the bounding rectangle is read back, and the mask is applied on collection
+    std::lock(m, DisplayObject::m);
+
+    makeCurrent();
+    pickMask = polygon;
+    paintGLPicks(x, y, toX - x + 1, toY - y + 1);
+
+    m.unlock();
+    DisplayObject::m.unlock();
+
+    readbackTimer.start();
+}
+
+
+void GLWidget::readRayPicks()
+{
+    std::set<std::pair<uint,uint>> picks;
+    if (rayPicker.result(&picks))
+        objectSet->setSelection(&picks, pickClears);
+}
+
+
+void GLWidget::readPicks()
+{
+    std::set<std::pair<uint,uint>> picks;
+
+    m.lock();
+    makeCurrent();
+    bool done = collectPicks(&picks);
+    m.unlock();
+
+    if (!done)
+        return;
+
+    readbackTimer.stop();
+    objectSet->setSelection(&picks, pickClears);
 }
 
 
@@ -436,7 +978,15 @@ void GLWidget::mouseMoveEvent(QMouseEvent *event)
     if (selectTracking)
     {
         selectTo = event->pos();
-        update();
+        if (!lasso.empty() && (event->buttons() & Qt::LeftButton) && lasso.back() != selectTo)
+            lasso.push_back(selectTo);
+        scheduler.invalidate(FL_OVERLAY);
+    }
+    else if (!cameraTracking)
+    {
+        // The readback happens in the next frame, so this stays cheap
+        hoverPos = event->pos();
+        scheduler.invalidate(FL_OVERLAY);
     }
 
     if (!cameraTracking)
@@ -472,7 +1022,13 @@ void GLWidget::mouseMoveEvent(QMouseEvent *event)
         setRoll(mouseOrigRoll - (shiftPressed ? 36.0 : 360.0) *
                 (event->pos().x() - mouseOrig.x()) / screen.width());
 
-    update();
+    scheduler.invalidate(FL_ALL);
+}
+
+
+void GLWidget::leaveEvent(QEvent *event)
+{
+    clearHover();
 }
 
 
@@ -486,7 +1042,7 @@ void GLWidget::wheelEvent(QWheelEvent *event)
     else
         setZoom(zoom() - (double) event->angleDelta().y() / 120.0 / (shiftPressed ? 400.0 : 40.0));
 
-    update();
+    scheduler.invalidate(FL_ALL);
 }
 
 
@@ -499,7 +1055,7 @@ void GLWidget::setInclination(double val)
     _inclination = val;
 
     emit inclinationChanged(val);
-    update();
+    scheduler.invalidate(FL_ALL);
 }
 
 
@@ -512,7 +1068,7 @@ void GLWidget::setAzimuth(double val)
     _azimuth = val;
 
     emit azimuthChanged(val);
-    update();
+    scheduler.invalidate(FL_ALL);
 }
 
 
@@ -525,7 +1081,7 @@ void GLWidget::setRoll(double val)
     _roll = val;
 
     emit rollChanged(val);
-    update();
+    scheduler.invalidate(FL_ALL);
 }
 
 
@@ -538,7 +1094,7 @@ void GLWidget::setFov(double val)
     _fov = val;
 
     emit fovChanged(val);
-    update();
+    scheduler.invalidate(FL_ALL);
 }
 
 
@@ -551,7 +1107,7 @@ void GLWidget::setZoom(double val)
     _zoom = val;
 
     emit zoomChanged(val);
-    update();
+    scheduler.invalidate(FL_ALL);
 }
 
 
@@ -560,7 +1116,7 @@ void GLWidget::setLookAt(QVector3D pt, bool fromMouse)
     _lookAt = pt;
 
     emit lookAtChanged(pt, fromMouse);
-    update();
+    scheduler.invalidate(FL_ALL);
 }
 
 
@@ -579,7 +1135,7 @@ void GLWidget::setPerspective(bool val)
         orthoOrigFov = _fov;
 
     emit perspectiveChanged(val);
-    update();
+    scheduler.invalidate(FL_ALL);
 }
 
 
@@ -652,7 +1208,7 @@ void GLWidget::setDir(direction val)
     _dir = val;
 
     emit dirChanged(val);
-    update();
+    scheduler.invalidate(FL_ALL);
 }
 
 
@@ -661,7 +1217,7 @@ void GLWidget::setRightHanded(bool val)
     _rightHanded = val;
 
     emit rightHandedChanged(val);
-    update();
+    scheduler.invalidate(FL_ALL);
 }
 
 
@@ -670,7 +1226,7 @@ void GLWidget::setShowAxes(bool val)
     _showAxes = val;
 
     emit showAxesChanged(val);
-    update();
+    scheduler.invalidate(FL_OVERLAY);
 }
 
 
@@ -678,16 +1234,105 @@ void GLWidget::setShowPoints(bool val)
 {
     _showPoints = val;
 
-    update();
+    scheduler.invalidate(FL_SCENE | FL_PICKING);
+}
+
+
+double GLWidget::benchmark(uint frames)
+{
+    QElapsedTimer timer;
+    timer.start();
+
+    for (uint i = 0; i < frames; i++)
+    {
+        scheduler.invalidate(FL_SCENE);
+        updateGL();
+    }
+
+    makeCurrent();
+    glFinish();
+
+    return timer.nsecsElapsed() / 1e6 / std::max(frames, 1u);
+}
+
+
+bool GLWidget::compactBuffers()
+{
+    return DisplayObject::compact();
+}
+
+
+void GLWidget::setCompactBuffers(bool val)
+{
+    DisplayObject::m.lock();
+    DisplayObject::setCompact(val);
+    DisplayObject::m.unlock();
+
+    uploadTessellations();
+}
+
+
+bool GLWidget::lowMemory()
+{
+    return DisplayObject::lowMemory();
+}
+
+
+void GLWidget::setLowMemory(bool val)
+{
+    DisplayObject::m.lock();
+    DisplayObject::setLowMemory(val);
+    DisplayObject::m.unlock();
+}
+
+
+bool GLWidget::occlusionCulling()
+{
+    return DisplayObject::occlusionCulling();
+}
+
+
+void GLWidget::setOcclusionCulling(bool val)
+{
+    DisplayObject::m.lock();
+    DisplayObject::setOcclusionCulling(val);
+    DisplayObject::m.unlock();
+
+    scheduler.invalidate(FL_SCENE);
 }
 
 
 void GLWidget::initializeDispObject(DisplayObject *obj)
 {
-    m.lock();
+    std::lock(m, DisplayObject::m);
     makeCurrent();
     obj->initialize();
     m.unlock();
+    DisplayObject::m.unlock();
+}
+
+
+void GLWidget::objectsChanged()
+{
+    scheduler.invalidate(FL_SCENE | FL_PICKING);
+}
+
+
+void GLWidget::selectionChanged()
+{
+    scheduler.invalidate(FL_SCENE);
+}
+
+
+void GLWidget::uploadTessellations()
+{
+    std::lock(m, DisplayObject::m);
+    makeCurrent();
+    DisplayObject::uploadPending();
+    m.unlock();
+    DisplayObject::m.unlock();
+
+    scheduler.invalidate(FL_SCENE | FL_PICKING);
 }
 
 
@@ -40,6 +40,7 @@
 
 #include <mutex>
 #include <unordered_map>
+#include <vector>
 
 #include <QVector3D>
 #include <QVector4D>
@@ -47,12 +48,17 @@
 #include <QGLWidget>
 #include <QMatrix4x4>
 #include <QMouseEvent>
+#include <QOpenGLFramebufferObject>
 #include <QOpenGLShaderProgram>
+#include <QOpenGLVertexArrayObject>
 #include <QSize>
+#include <QTimer>
 #include <QWheelEvent>
 
 #include "ObjectSet.h"
 #include "DisplayObject.h"
+#include "FrameScheduler.h"
+#include "RayPicker.h"
 
 #ifndef _GLWIDGET_H_
 #define _GLWIDGET_H_
@@ -116,11 +122,72 @@ public:
     inline bool showPoints() { return _showPoints; }
     void setShowPoints(bool val);
 
+    //! \brief Whether objects are uploaded in the compact vertex format. See
+    //! DisplayObject::setCompact().
+    bool compactBuffers();
+    void setCompactBuffers(bool val);
+
+    //! \brief Whether CPU-side geometry is released after uploading. See
+    //! DisplayObject::setLowMemory().
+    bool lowMemory();
+    void setLowMemory(bool val);
+
+    //! \brief Whether patches hidden behind others are skipped. See
+    //! DisplayObject::setOcclusionCulling().
+    bool occlusionCulling();
+    void setOcclusionCulling(bool val);
+
+    //! \brief Whether picking casts rays on the CPU (see RayPicker) instead of drawing the
+    //! picking pass.
+    inline bool rayPicking() { return _rayPicking; }
+    inline void setRayPicking(bool val) { _rayPicking = val; }
+
+    //! \brief Whether box selection takes every visible component inside the rectangle, also the
+    //! occluded ones (see DisplayObject::xrayAll()).
+    inline bool xraySelection() { return _xraySelection; }
+    inline void setXraySelection(bool val) { _xraySelection = val; }
+
+    //! \brief Renders the scene a number of times, and returns the average time per frame in
+    //! milliseconds, including the time for the GPU to finish.
+    double benchmark(uint frames);
+
+    //! Returns the number of draw calls used for the objects in the last frame.
+    inline uint drawCalls() { return _drawCalls; }
+
+    //! Returns the number of patches culled from the last frame.
+    inline uint culledPatches() { return _culledPatches; }
+
+    //! Returns the number of patches held back as occluded in the last frame.
+    inline uint occludedPatches() { return _occludedPatches; }
+
+    //! Returns the number of patches culled from the last picking pass.
+    inline uint culledPicks() { return _culledPicks; }
+
+    //! Returns the number of repaint requests, coalesced or not (see FrameScheduler).
+    inline uint requestedFrames() { return scheduler.requestedFrames(); }
+
+    //! Returns the number of frames drawn.
+    inline uint renderedFrames() { return scheduler.renderedFrames(); }
+
     void keyPressEvent(QKeyEvent *event);
     void keyReleaseEvent(QKeyEvent *event);
 
 public slots:
     void initializeDispObject(DisplayObject *obj);
+    void uploadTessellations();
+
+    //! Schedules a frame for changed objects or visibility.
+    void objectsChanged();
+
+    //! Schedules a frame for a changed selection.
+    void selectionChanged();
+
+private slots:
+    //! Applies the selection from the last picking pass, once its pixels have arrived.
+    void readPicks();
+
+    //! Applies the selection from the ray picker.
+    void readRayPicks();
 
 signals:
     void inclinationChanged(double val);
@@ -139,28 +206,94 @@ protected:
     void initializeGL();
     void resizeGL(int w, int h);
     void paintGL();
-    std::set<std::pair<uint,uint>> paintGLPicks(int x, int y, int w, int h);
+
+    //! \brief Draws the picking pass and starts reading the given rectangle back into
+    //! #pickPixels. The result is collected later by collectPicks().
+    void paintGLPicks(int x, int y, int w, int h);
+
+    //! \brief Collects the (index, offset) pairs from the last picking pass, if the readback has
+    //! finished. Returns false if it is still in flight.
+    bool collectPicks(std::set<std::pair<uint,uint>> *picks);
 
     void mousePressEvent(QMouseEvent *event);
     void mouseReleaseEvent(QMouseEvent *event);
     void mouseMoveEvent(QMouseEvent *event);
     void wheelEvent(QWheelEvent *event);
+    void leaveEvent(QEvent *event);
 
 private:
+    void drawScene();
+
+    //! Binds #pickBuffer, and returns true if its storage was (re)allocated.
+    bool bindPickBuffer();
+
+    //! Binds #pickBuffer, and draws it if the picking layer is dirty.
+    void drawPickBuffer();
+
+    //! \brief Collects the pixel under the cursor once it has arrived, and starts reading it
+    //! again if the cursor has moved. Called from paintGL(), which is asked for another frame
+    //! while a read is in flight.
+    void updateHover();
+
+    //! Removes the hover highlight.
+    void clearHover();
     void drawAxes();
     void drawSelection();
+
+    //! Closes the lasso or polygon, and picks inside it.
+    void finishLasso();
+    void setCamera(const QMatrix4x4 &mvp);
     void matrix(QMatrix4x4 *);
     void axesMatrix(QMatrix4x4 *);
     void multiplyDir(QMatrix4x4 *);
 
-    QOpenGLShaderProgram vcProgram, ccProgram;
-    QOpenGLBuffer auxBuffer, axesBuffer, selectionBuffer, auxCBuffer;
+    QOpenGLShaderProgram vcProgram, ccProgram, sceneProgram, pickProgram;
+
+    //! The object and picking programs for lines, widened in a geometry shader.
+    QOpenGLShaderProgram ccLineProgram, pickLineProgram;
+
+    //! The widths supported by glLineWidth(), which the core profile may limit to one pixel.
+    GLfloat lineWidthRange[2];
+    QOpenGLVertexArrayObject vao;
+
+    //! The scene is rendered (multisampled) into sceneBuffer and resolved into sceneTexture,
+    //! which is reused for frames that only change the overlays.
+    QOpenGLFramebufferObject *sceneBuffer, *sceneTexture;
+
+    //! \brief The offscreen framebuffer for picking, with an unsigned integer color buffer of
+    //! (index, offset) pairs and a depth buffer. See DisplayObject::drawPicking().
+    GLuint pickBuffer, pickRenderbuffers[2];
+    QSize pickSize;
+
+    //! \brief The pixel buffer receiving the picked rectangle, and the fence signalled when the
+    //! copy is done.
+    GLuint pickPixels;
+    GLsync pickFence;
+    int pickX, pickY, pickWidth, pickHeight;
+    bool pickClears;
+
+    //! The polygon of the pick in flight, in widget coordinates, or empty for the whole rectangle.
+    std::vector<QPoint> pickMask;
+    QTimer readbackTimer;
+
+    //! \brief The pixel buffer and fence for reading the (index, offset) pair under the cursor
+    //! from #pickBuffer, which is kept until the picking layer is dirty.
+    GLuint hoverPixels;
+    GLsync hoverFence;
+    QPoint hoverPos, hoverRead;
+    std::pair<uint,uint> hovered;
+
+    QOpenGLBuffer auxBuffer, axesBuffer, selectionBuffer, auxCBuffer, cameraBuffer, lassoBuffer;
 
     ObjectSet *objectSet;
 
     bool shiftPressed, ctrlPressed, altPressed;
 
     double _inclination, _azimuth, _roll, _fov, _zoom, _diameter;
+    uint _drawCalls, _culledPatches, _occludedPatches, _culledPicks;
+    FrameScheduler scheduler;
+    RayPicker rayPicker;
+    bool _rayPicking, _xraySelection;
     bool _perspective, _fixed, _rightHanded, _showAxes, _showPoints;
     QVector3D _lookAt;
     direction _dir;
@@ -168,6 +301,10 @@ private:
     bool selectTracking;
     QPoint selectOrig, selectTo;
 
+    //! \brief The corners of the lasso or polygon being drawn, in widget coordinates. Empty when
+    //! selecting a rectangle.
+    std::vector<QPoint> lasso;
+
     bool cameraTracking;
     QPoint mouseOrig;
     double mouseOrigInclination, mouseOrigAzimuth, mouseOrigRoll;
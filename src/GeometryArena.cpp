@@ -0,0 +1,178 @@
+/*
+ * Copyright (C) 2014 SINTEF ICT,
+ * Applied Mathematics, Norway.
+ *
+ * Contact information:
+ * E-mail: eivind.fonn@sintef.no
+ * SINTEF ICT, Department of Applied Mathematics,
+ * P.O. Box 4760 Sluppen,
+ * 7045 Trondheim, Norway.
+ *
+ * This file is part of BSGUI.
+ *
+ * BSGUI is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * BSGUI is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public
+ * License along with GoTools. If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In accordance with Section 7(b) of the GNU Affero General Public
+ * License, a covered work must retain the producer line in every data
+ * file that is created or manipulated using GoTools.
+ *
+ * Other Usage
+ * You can be released from the requirements of the license by purchasing
+ * a commercial license. Buying such a license is mandatory as soon as you
+ * develop commercial activities involving the GoTools library without
+ * disclosing the source code of your own applications.
+ *
+ * This file may be used in accordance with the terms contained in a
+ * written agreement between you and SINTEF ICT.
+ */
+
+#include <algorithm>
+#include <iterator>
+#include <new>
+
+#include <QOpenGLContext>
+#include <QOpenGLFunctions_3_2_Core>
+
+#include "GeometryArena.h"
+
+
+GeometryArena::GeometryArena(QOpenGLBuffer::Type type, uint alignment)
+    : _buffer(type)
+    , type(type)
+    , alignment(alignment)
+    , _capacity(0)
+    , _used(0)
+    , _generation(0)
+{
+}
+
+
+GeometryArena::~GeometryArena()
+{
+    if (_buffer.isCreated() && QOpenGLContext::currentContext())
+        _buffer.destroy();
+}
+
+
+uint GeometryArena::allocate(uint size)
+{
+    size = std::max(size, 1u);
+
+    for (auto block : freeBlocks)
+    {
+        uint offset = (block.first + alignment - 1) / alignment * alignment;
+        uint end = block.first + block.second;
+        if (offset + size > end)
+            continue;
+
+        freeBlocks.erase(block.first);
+        if (offset > block.first)
+            freeBlocks[block.first] = offset - block.first;
+        if (offset + size < end)
+            freeBlocks[offset + size] = end - offset - size;
+
+        usedBlocks[offset] = size;
+        _used += size;
+        return offset;
+    }
+
+    // No room, so grow and try again. The new space is merged with a free block at the end.
+    // OpenGL buffers are sized by a signed int in Qt, which bounds the arena.
+    if ((size_t) _capacity + size + alignment > GEOMETRYARENA_MAX_CAPACITY)
+        throw std::bad_alloc();
+    size_t grown = std::max(2 * (size_t) _capacity, (size_t) _capacity + size + alignment);
+    grow(std::min(grown, (size_t) GEOMETRYARENA_MAX_CAPACITY));
+    return allocate(size);
+}
+
+
+void GeometryArena::free(uint offset)
+{
+    auto it = usedBlocks.find(offset);
+    if (it == usedBlocks.end())
+        return;
+
+    _used -= it->second;
+    addFree(it->first, it->second);
+    usedBlocks.erase(it);
+}
+
+
+void GeometryArena::write(uint offset, const void *data, uint size)
+{
+    _buffer.bind();
+    _buffer.write(offset, data, size);
+}
+
+
+void GeometryArena::reserve(uint size)
+{
+    if (size > GEOMETRYARENA_MAX_CAPACITY)
+        throw std::bad_alloc();
+    if (size > _capacity)
+        grow(std::min(std::max(2 * (size_t) _capacity, (size_t) size), (size_t) GEOMETRYARENA_MAX_CAPACITY));
+}
+
+
+void GeometryArena::grow(uint size)
+{
+    size = std::max(size, (uint) GEOMETRYARENA_INITIAL_CAPACITY);
+
+    QOpenGLBuffer grown(type);
+    grown.create();
+    grown.setUsagePattern(QOpenGLBuffer::StaticDraw);
+    grown.bind();
+    grown.allocate(size);
+
+    // Arenas written through reserve() and write() have no allocated blocks, so the whole
+    // buffer is copied regardless
+    if (_buffer.isCreated())
+    {
+        QOpenGLFunctions_3_2_Core *gl =
+            QOpenGLContext::currentContext()->versionFunctions<QOpenGLFunctions_3_2_Core>();
+        gl->glBindBuffer(GL_COPY_READ_BUFFER, _buffer.bufferId());
+        gl->glBindBuffer(GL_COPY_WRITE_BUFFER, grown.bufferId());
+        gl->glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, _capacity);
+        _buffer.destroy();
+    }
+
+    addFree(_capacity, size - _capacity);
+    _buffer = grown;
+    _capacity = size;
+    _generation++;
+}
+
+
+void GeometryArena::addFree(uint offset, uint size)
+{
+    auto next = freeBlocks.lower_bound(offset);
+    if (next != freeBlocks.end() && offset + size == next->first)
+    {
+        size += next->second;
+        next = freeBlocks.erase(next);
+    }
+
+    if (next != freeBlocks.begin())
+    {
+        auto prev = std::prev(next);
+        if (prev->first + prev->second == offset)
+        {
+            prev->second += size;
+            return;
+        }
+    }
+
+    freeBlocks[offset] = size;
+}
@@ -0,0 +1,125 @@
+/*
+ * Copyright (C) 2014 SINTEF ICT,
+ * Applied Mathematics, Norway.
+ *
+ * Contact information:
+ * E-mail: eivind.fonn@sintef.no
+ * SINTEF ICT, Department of Applied Mathematics,
+ * P.O. Box 4760 Sluppen,
+ * 7045 Trondheim, Norway.
+ *
+ * This file is part of BSGUI.
+ *
+ * BSGUI is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * BSGUI is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public
+ * License along with GoTools. If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In accordance with Section 7(b) of the GNU Affero General Public
+ * License, a covered work must retain the producer line in every data
+ * file that is created or manipulated using GoTools.
+ *
+ * Other Usage
+ * You can be released from the requirements of the license by purchasing
+ * a commercial license. Buying such a license is mandatory as soon as you
+ * develop commercial activities involving the GoTools library without
+ * disclosing the source code of your own applications.
+ *
+ * This file may be used in accordance with the terms contained in a
+ * written agreement between you and SINTEF ICT.
+ */
+
+#include <map>
+
+#include <QOpenGLBuffer>
+
+#ifndef _GEOMETRYARENA_H_
+#define _GEOMETRYARENA_H_
+
+#define GEOMETRYARENA_INITIAL_CAPACITY (4 * 1024 * 1024)
+#define GEOMETRYARENA_MAX_CAPACITY 0x7fffffff
+
+typedef unsigned int uint;
+
+//! \brief A large OpenGL buffer from which many objects suballocate their data.
+//!
+//! Keeping the geometry of all patches in a few shared buffers means that the buffers only have to
+//! be bound once per frame, and that many patches can be drawn with a single multi-draw call.
+//!
+//! Blocks are allocated first fit from a list of free blocks, and adjacent free blocks are merged
+//! when a block is freed. Offsets are rounded up to a multiple of the alignment given at
+//! construction, which need not be a power of two. This allows vertex blocks to be aligned to the
+//! vertex size, so that block offsets can be used as base vertices. When no free block is large
+//! enough, the buffer grows by doubling, and the old contents are copied on the GPU.
+//!
+//! Allocating and freeing only touch the bookkeeping, so they can be done without an OpenGL
+//! context. Writing and growing require the context to be current. Like the rest of the OpenGL
+//! state, an arena is protected by DisplayObject::m.
+class GeometryArena
+{
+public:
+    //! \brief Creates an empty arena. The OpenGL buffer is created on first use.
+    //!
+    //! \param type The type of the OpenGL buffer.
+    //! \param alignment Block offsets are multiples of this number of bytes.
+    GeometryArena(QOpenGLBuffer::Type type, uint alignment);
+
+    //! \brief Destroys the OpenGL buffer, if there is a current context to destroy it in.
+    ~GeometryArena();
+
+    //! \brief Allocates a block of \a size bytes, growing the buffer if necessary. Throws
+    //! std::bad_alloc if the buffer would exceed #GEOMETRYARENA_MAX_CAPACITY.
+    //! \return The offset of the block in bytes.
+    uint allocate(uint size);
+
+    //! Frees a block returned from allocate().
+    void free(uint offset);
+
+    //! Writes \a size bytes to the buffer at the given offset.
+    void write(uint offset, const void *data, uint size);
+
+    //! \brief Makes sure the buffer has room for at least \a size bytes, without allocating
+    //! anything. Throws std::bad_alloc if \a size exceeds #GEOMETRYARENA_MAX_CAPACITY.
+    void reserve(uint size);
+
+    //! Returns the OpenGL buffer. Its identity changes when the arena grows.
+    inline QOpenGLBuffer &buffer() { return _buffer; }
+
+    //! Returns the size of the OpenGL buffer in bytes.
+    inline uint capacity() { return _capacity; }
+
+    //! Returns the number of bytes in allocated blocks.
+    inline uint used() { return _used; }
+
+    //! Returns the number of times the buffer has been reallocated.
+    inline uint generation() { return _generation; }
+
+private:
+    QOpenGLBuffer _buffer;
+    QOpenGLBuffer::Type type;
+    uint alignment;
+    uint _capacity, _used, _generation;
+
+    //! Free blocks, mapping offset to size.
+    std::map<uint, uint> freeBlocks;
+
+    //! Allocated blocks, mapping offset to size.
+    std::map<uint, uint> usedBlocks;
+
+    //! Reallocates the buffer with room for at least \a size bytes, keeping the contents.
+    void grow(uint size);
+
+    //! Adds a free block, merging it with its neighbours.
+    void addFree(uint offset, uint size);
+};
+
+#endif /* _GEOMETRYARENA_H_ */
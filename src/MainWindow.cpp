@@ -38,6 +38,7 @@
  * written agreement between you and SINTEF ICT.
  */
 
+#include <iterator>
 #include <sstream>
 #include <thread>
 #include <QApplication>
@@ -52,6 +53,8 @@
 
 #include "MainWindow.h"
 
+#define BENCHMARK_FRAMES 100
+
 
 MainWindow::MainWindow(QWidget *parent, Qt::WindowFlags flags)
     : QMainWindow(parent, flags)
@@ -111,6 +114,32 @@ MainWindow::MainWindow(QWidget *parent, Qt::WindowFlags flags)
             [] () { QApplication::exit(0); });
 
 
+    QMenu *toolsMenu = menuBar()->addMenu("Tools");
+    QAction *benchmarkAct = toolsMenu->addAction("Benchmark rendering");
+
+    connect(benchmarkAct, &QAction::triggered,
+            [this] (bool checked) {
+                DisplayObject::m.lock();
+                uint patches = std::distance(DisplayObject::begin(), DisplayObject::end());
+                DisplayObject::m.unlock();
+
+                double ms = _glWidget->benchmark(BENCHMARK_FRAMES);
+                emit _objectSet->log(QString("Rendered %1 patches in %2 ms per frame "
+                                             "(%3 draw calls, %4 patches culled, %5 occluded)")
+                                     .arg(patches).arg(ms, 0, 'f', 2).arg(_glWidget->drawCalls())
+                                     .arg(_glWidget->culledPatches()).arg(_glWidget->occludedPatches()));
+            });
+
+    QAction *framesAct = toolsMenu->addAction("Frame statistics");
+
+    connect(framesAct, &QAction::triggered,
+            [this] (bool checked) {
+                emit _objectSet->log(QString("%1 frames requested, %2 rendered")
+                                     .arg(_glWidget->requestedFrames())
+                                     .arg(_glWidget->renderedFrames()));
+            });
+
+
     QMenu *windowsMenu = menuBar()->addMenu("Windows");
     _toolAct = windowsMenu->addAction("Toolbox");
     _toolAct->setShortcut(QKeySequence("Ctrl+Shift+T"));
@@ -39,6 +39,7 @@
  */
 
 #include <algorithm>
+#include <cmath>
 #include <thread>
 #include <QBrush>
 #include <QFileInfo>
@@ -313,17 +314,28 @@ ObjectSet::ObjectSet(QObject *parent)
     : QAbstractItemModel(parent)
     , _selectionMode(SM_PATCH)
     , watch(true)
+    , _quality(1.0)
 {
     root = new Node();
 
     fileWatcher = std::thread([this] () { watchFiles(); });
+
+    uint nTessellators = std::max(2u, std::thread::hardware_concurrency()) - 1;
+    for (uint i = 0; i < nTessellators; i++)
+        tessellators.push_back(std::thread([this] () { tessellate(); }));
 }
 
 
 ObjectSet::~ObjectSet()
 {
+    mTessQueue.lock();
     watch = false;
+    mTessQueue.unlock();
+    tessQueueChanged.notify_all();
+
     fileWatcher.join();
+    for (auto &t : tessellators)
+        t.join();
 
     delete root;
 }
@@ -480,6 +492,124 @@ void ObjectSet::showAll()
 }
 
 
+void ObjectSet::setQuality(float quality, bool selectionOnly)
+{
+    std::vector<TessellationJob> jobs;
+
+    DisplayObject::m.lock();
+
+    if (!selectionOnly)
+        _quality = quality;
+
+    for (auto i = DisplayObject::begin(); i != DisplayObject::end(); i++)
+    {
+        DisplayObject *obj = i->second;
+        if ((selectionOnly && !obj->hasSelection()) || obj->quality() == quality)
+            continue;
+
+        TessellationJob job;
+        job.index = i->first;
+        job.run = obj->requestTessellation(quality, &job.request);
+        jobs.push_back(job);
+    }
+
+    DisplayObject::m.unlock();
+
+    if (queueTessellations(jobs))
+        emit log(QString("Re-tessellating %1 patches at quality %2").arg(jobs.size()).arg(quality));
+}
+
+
+float ObjectSet::curveTolerance()
+{
+    DisplayObject::m.lock();
+    float tolerance = Curve::tolerance;
+    DisplayObject::m.unlock();
+
+    return tolerance;
+}
+
+
+void ObjectSet::setCurveTolerance(float tolerance)
+{
+    std::vector<TessellationJob> jobs;
+
+    DisplayObject::m.lock();
+
+    Curve::tolerance = tolerance;
+
+    for (auto i = DisplayObject::begin(); i != DisplayObject::end(); i++)
+    {
+        DisplayObject *obj = i->second;
+        if (obj->type() != OT_CURVE)
+            continue;
+
+        TessellationJob job;
+        job.index = i->first;
+        job.run = obj->requestTessellation(obj->quality(), &job.request);
+        jobs.push_back(job);
+    }
+
+    DisplayObject::m.unlock();
+
+    if (queueTessellations(jobs))
+        emit log(QString("Re-tessellating %1 curves with tolerance %2").arg(jobs.size()).arg(tolerance));
+}
+
+
+bool ObjectSet::queueTessellations(const std::vector<TessellationJob> &jobs)
+{
+    if (jobs.empty())
+        return false;
+
+    mTessQueue.lock();
+    tessQueue.insert(tessQueue.end(), jobs.begin(), jobs.end());
+    mTessQueue.unlock();
+    tessQueueChanged.notify_all();
+
+    return true;
+}
+
+
+void ObjectSet::tessellate()
+{
+    while (true)
+    {
+        std::unique_lock<std::mutex> lock(mTessQueue);
+        tessQueueChanged.wait(lock, [this] () { return !watch || !tessQueue.empty(); });
+        if (!watch)
+            return;
+
+        TessellationJob job = tessQueue.front();
+        tessQueue.pop_front();
+        lock.unlock();
+
+        // Skip requests that have been superseded while waiting in the queue
+        DisplayObject::m.lock();
+        DisplayObject *obj = DisplayObject::getObject(job.index);
+        bool current = obj && obj->tessellationCurrent(job.request);
+        DisplayObject::m.unlock();
+
+        if (!current)
+            continue;
+
+        // The old geometry stays on screen until the new one is uploaded by the GL thread
+        Tessellation *data = new Tessellation();
+        job.run(*data);
+
+        DisplayObject::m.lock();
+        obj = DisplayObject::getObject(job.index);
+        bool accepted = obj && obj->setTessellation(job.request, data);
+        DisplayObject::m.unlock();
+
+        if (accepted)
+            emit tessellationReady();
+        else
+            delete data;
+    }
+}
+
+
 QModelIndex ObjectSet::index(int row, int column, const QModelIndex &parent) const
 {
     if (!hasIndex(row, column, parent))
@@ -751,7 +881,7 @@ bool ObjectSet::addPatchFromStream(std::ifstream &stream, File *file)
             delete v;
             return false;
         }
-        obj = new Volume(v);
+        obj = new Volume(v, _quality);
         break;
     }
     case Go::Class_SplineSurface:
@@ -764,7 +894,7 @@ bool ObjectSet::addPatchFromStream(std::ifstream &stream, File *file)
             delete s;
             return false;
         }
-        obj = new Surface(s);
+        obj = new Surface(s, _quality);
         break;
     }
     case Go::Class_SplineCurve:
@@ -777,7 +907,7 @@ bool ObjectSet::addPatchFromStream(std::ifstream &stream, File *file)
             delete c;
             return false;
         }
-        obj = new Curve(c);
+        obj = new Curve(c, _quality);
         break;
     }
     default:
@@ -818,16 +948,23 @@ bool ObjectSet::addPatchFromStream(std::ifstream &stream, File *file)
 }
 
 
+//! Returns the largest distance from a point to the box with corners \a lo and \a hi.
+inline float farthestCorner(const QVector3D &lo, const QVector3D &hi, const QVector3D &point)
+{
+    QVector3D d(std::max(std::abs(lo.x() - point.x()), std::abs(hi.x() - point.x())),
+                std::max(std::abs(lo.y() - point.y()), std::abs(hi.y() - point.y())),
+                std::max(std::abs(lo.z() - point.z()), std::abs(hi.z() - point.z())));
+    return d.length();
+}
+
+
 void ObjectSet::boundingSphere(QVector3D *center, float *radius)
 {
     DisplayObject::m.lock();
 
-    bool hasVisible = any_of(DisplayObject::begin(), DisplayObject::end(),
-                             [] (std::pair<const uint, DisplayObject *> &i) {
-                                 return !i.second->isInvisible(false);
-                             });
+    const BoundingTree &tree = DisplayObject::hierarchy();
 
-    if (!hasVisible)
+    if (tree.size() == 0)
     {
         *center = QVector3D(0,0,0);
         *radius = 0.0;
@@ -849,10 +986,14 @@ void ObjectSet::boundingSphere(QVector3D *center, float *radius)
 
     ritterSphere(center, radius, hasSelection);
 
+    // Only subtrees that may hold a larger radius need to be searched
     float maxRadius = 0.0;
-    for (auto i = DisplayObject::begin(); i != DisplayObject::end(); i++)
-        if (i->second->radius() > maxRadius && (!hasSelection || i->second->hasSelection()))
-            maxRadius = i->second->radius();
+    tree.traverse(
+        [&maxRadius] (const QVector3D &, const QVector3D &, float r) { return r > maxRadius; },
+        [&maxRadius, hasSelection] (uint index, const QVector3D &, float r) {
+            if (!hasSelection || DisplayObject::getObject(index)->hasSelection())
+                maxRadius = std::max(maxRadius, r);
+        });
 
     *radius += 2 * maxRadius;
 
@@ -1035,42 +1176,46 @@ File *ObjectSet::getOrCreateFileNode(QString fileName)
 void ObjectSet::farthestPointFrom(DisplayObject *a, DisplayObject **b, bool hasSelection)
 {
     float distance = -1;
-
-    for (auto i = DisplayObject::begin(); i != DisplayObject::end(); i++)
-    {
-        if (i->second->isInvisible(false))
-            continue;
-
-        if (hasSelection && !i->second->hasSelection())
-            continue;
-
-        float _distance = (i->second->center() - a->center()).length();
-        if (_distance > distance)
-        {
-            distance = _distance;
-            *b = i->second;
-        }
-    }
+    QVector3D point = a->center();
+
+    // Branch and bound: skip boxes whose farthest corner is closer than the best candidate
+    DisplayObject::hierarchy().traverse(
+        [&distance, &point] (const QVector3D &lo, const QVector3D &hi, float) {
+            return farthestCorner(lo, hi, point) > distance;
+        },
+        [&distance, &point, b, hasSelection] (uint index, const QVector3D &c, float) {
+            DisplayObject *obj = DisplayObject::getObject(index);
+            if (hasSelection && !obj->hasSelection())
+                return;
+
+            float _distance = (c - point).length();
+            if (_distance > distance)
+            {
+                distance = _distance;
+                *b = obj;
+            }
+        });
 }
 
 
 void ObjectSet::ritterSphere(QVector3D *center, float *radius, bool hasSelection)
 {
-    for (auto i = DisplayObject::begin(); i != DisplayObject::end(); i++)
-    {
-        if (i->second->isInvisible(false))
-            continue;
-
-        if (hasSelection && !i->second->hasSelection())
-            continue;
-
-        float d = (i->second->center() - (*center)).length();
-        if (d > (*radius))
-        {
-            *center = ((d + (*radius))/2 * (*center) + (d - (*radius))/2 * i->second->center()) / d;
-            *radius = (d + (*radius))/2;
-        }
-    }
+    // The sphere only grows, so boxes found inside it can be skipped for good
+    DisplayObject::hierarchy().traverse(
+        [center, radius] (const QVector3D &lo, const QVector3D &hi, float) {
+            return farthestCorner(lo, hi, *center) > *radius;
+        },
+        [center, radius, hasSelection] (uint index, const QVector3D &c, float) {
+            if (hasSelection && !DisplayObject::getObject(index)->hasSelection())
+                return;
+
+            float d = (c - (*center)).length();
+            if (d > (*radius))
+            {
+                *center = ((d + (*radius))/2 * (*center) + (d - (*radius))/2 * c) / d;
+                *radius = (d + (*radius))/2;
+            }
+        });
 }
 
 
@@ -38,7 +38,10 @@
  * written agreement between you and SINTEF ICT.
  */
 
+#include <condition_variable>
+#include <deque>
 #include <fstream>
+#include <functional>
 #include <mutex>
 #include <set>
 #include <string>
@@ -193,6 +196,11 @@ public:
     void showAllSelectedPatches(bool visible);
     void showAll();
 
+    inline float quality() { return _quality; }
+    void setQuality(float quality, bool selectionOnly);
+    float curveTolerance();
+    void setCurveTolerance(float tolerance);
+
     std::mutex m;
 
     QVariant headerData(int section, Qt::Orientation orientation, int role) const;
@@ -212,6 +220,7 @@ public:
 
 signals:
     void requestInitialization(DisplayObject *obj);
+    void tessellationReady();
     void update();
     void selectionChanged();
     void selectionModeChanged(SelectionMode mode);
@@ -229,6 +238,20 @@ private:
     std::mutex mQueue;
     std::set<QString> loadQueue;
 
+    struct TessellationJob
+    {
+        uint index, request;
+        std::function<void(Tessellation &)> run;
+    };
+
+    float _quality;
+    std::vector<std::thread> tessellators;
+    void tessellate();
+    bool queueTessellations(const std::vector<TessellationJob> &jobs);
+    std::mutex mTessQueue;
+    std::condition_variable tessQueueChanged;
+    std::deque<TessellationJob> tessQueue;
+
     void farthestPointFrom(DisplayObject *a, DisplayObject **b, bool hasSelection);
     void ritterSphere(QVector3D *center, float *radius, bool hasSelection);
 
@@ -0,0 +1,223 @@
+/*
+ * Copyright (C) 2014 SINTEF ICT,
+ * Applied Mathematics, Norway.
+ *
+ * Contact information:
+ * E-mail: eivind.fonn@sintef.no
+ * SINTEF ICT, Department of Applied Mathematics,
+ * P.O. Box 4760 Sluppen,
+ * 7045 Trondheim, Norway.
+ *
+ * This file is part of BSGUI.
+ *
+ * BSGUI is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * BSGUI is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public
+ * License along with GoTools. If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In accordance with Section 7(b) of the GNU Affero General Public
+ * License, a covered work must retain the producer line in every data
+ * file that is created or manipulated using GoTools.
+ *
+ * Other Usage
+ * You can be released from the requirements of the license by purchasing
+ * a commercial license. Buying such a license is mandatory as soon as you
+ * develop commercial activities involving the GoTools library without
+ * disclosing the source code of your own applications.
+ *
+ * This file may be used in accordance with the terms contained in a
+ * written agreement between you and SINTEF ICT.
+ */
+
+#include <algorithm>
+#include <cmath>
+
+#include <QVector4D>
+
+#include "RayPicker.h"
+
+
+RayPicker::RayPicker(QObject *parent)
+    : QObject(parent)
+    , running(true)
+    , generation(0)
+    , nextRow(0)
+    , doneRows(0)
+    , rows(0)
+    , regenerating(false)
+    , ready(false)
+{
+    uint nWorkers = std::max(2u, std::thread::hardware_concurrency()) - 1;
+    for (uint i = 0; i < nWorkers; i++)
+        workers.push_back(std::thread([this] () { work(); }));
+}
+
+
+RayPicker::~RayPicker()
+{
+    m.lock();
+    running = false;
+    m.unlock();
+    jobChanged.notify_all();
+
+    for (auto &t : workers)
+        t.join();
+}
+
+
+void RayPicker::pick(const QMatrix4x4 &mvp, int width, int height, int x, int y, int w, int h,
+                     SelectionMode mode)
+{
+    m.lock();
+
+    generation++;
+    int stride = std::max((int) std::ceil(std::sqrt((double) w * h / RAYPICKER_MAX_RAYS)), 1);
+
+    // Rays hit edges beside them, so objects just outside the rectangle count too
+    float margin = PICK_EDGE_MARGIN;
+    float gx = x - margin, gy = y - margin, gw = w + 2 * margin, gh = h + 2 * margin;
+    QMatrix4x4 region;
+    region.scale(width / gw, height / gh, 1.0);
+    region.translate(1.0 - (2.0 * gx + gw) / width, 1.0 - (2.0 * gy + gh) / height, 0.0);
+
+    job = { mvp.inverted(), width, height, x, y, w, h, stride, mode, region * mvp };
+
+    rows = (h + stride - 1) / stride;
+    nextRow = doneRows = 0;
+    counts.clear();
+    regenerated.reset();
+    ready = false;
+
+    m.unlock();
+    jobChanged.notify_all();
+}
+
+
+bool RayPicker::result(std::set<std::pair<uint,uint>> *picks)
+{
+    std::lock_guard<std::mutex> lock(m);
+    if (!ready)
+        return false;
+
+    picks->swap(this->picks);
+    this->picks.clear();
+    ready = false;
+    return true;
+}
+
+
+void RayPicker::work()
+{
+    while (true)
+    {
+        std::unique_lock<std::mutex> lock(m);
+        jobChanged.wait(lock, [this] () { return !running || (!regenerating && nextRow < rows); });
+        if (!running)
+            return;
+
+        uint myGeneration = generation;
+        Job myJob = job;
+
+        // The first worker on a pick regenerates the released geometry, while the others wait
+        if (!regenerated)
+        {
+            regenerating = true;
+            lock.unlock();
+
+            std::shared_ptr<RegeneratedGeometry> data = std::make_shared<RegeneratedGeometry>();
+            regenerate(myJob, data.get());
+
+            lock.lock();
+            regenerating = false;
+            if (myGeneration == generation)
+                regenerated = data;
+            lock.unlock();
+            jobChanged.notify_all();
+            continue;
+        }
+
+        uint row = nextRow++;
+        std::shared_ptr<const RegeneratedGeometry> myRegenerated = regenerated;
+        lock.unlock();
+
+        std::map<std::pair<uint,uint>, uint> rowCounts;
+        castRow(myJob, row, *myRegenerated, rowCounts);
+
+        lock.lock();
+        if (myGeneration != generation)
+            continue;
+
+        for (auto &c : rowCounts)
+            counts[c.first] += c.second;
+        if (++doneRows < rows)
+            continue;
+
+        // Each ray stands for stride^2 pixels
+        int limit = std::min(std::min(job.w, job.h) - 1, 2);
+        picks.clear();
+        for (auto &c : counts)
+            if ((int) (c.second * job.stride * job.stride) >= limit)
+                picks.insert(c.first);
+        regenerated.reset();
+        ready = true;
+        lock.unlock();
+
+        emit finished();
+    }
+}
+
+
+void RayPicker::regenerate(const Job &job, RegeneratedGeometry *regenerated)
+{
+    std::vector<std::pair<uint, std::function<void(Tessellation &)>>> jobs;
+    DisplayObject::m.lock_shared();
+    DisplayObject::regenerationJobs(Frustum(job.region), &jobs);
+    DisplayObject::m.unlock_shared();
+
+    // Like the tessellation jobs, these run without any locks held
+    for (auto &j : jobs)
+        j.second((*regenerated)[j.first]);
+}
+
+
+void RayPicker::castRow(const Job &job, uint row, const RegeneratedGeometry &regenerated,
+                        std::map<std::pair<uint,uint>, uint> &counts)
+{
+    auto unproject = [&job] (float px, float py, float z) {
+        QVector4D p = job.inverse * QVector4D(2.0 * px / job.width - 1.0, 2.0 * py / job.height - 1.0, z, 1.0);
+        return p.toVector3D() / p.w();
+    };
+
+    float py = job.y + row * job.stride + 0.5;
+
+    DisplayObject::m.lock_shared();
+    for (int i = 0; i < job.w; i += job.stride)
+    {
+        float px = job.x + i + 0.5;
+        QVector3D near0 = unproject(px, py, -1.0), far0 = unproject(px, py, 1.0);
+        QVector3D near1 = unproject(px + 1.0, py, -1.0), far1 = unproject(px + 1.0, py, 1.0);
+
+        PickRay ray;
+        ray.origin = near0;
+        ray.direction = far0 - near0;
+        ray.length = ray.direction.length();
+        ray.direction /= ray.length;
+        ray.pixel = (near1 - near0).length();
+        ray.pixelGrowth = ((far1 - far0).length() - ray.pixel) / ray.length;
+
+        uint index, offset;
+        DisplayObject::raycastAll(ray, job.mode, &index, &offset, regenerated);
+        if (index != PICK_NONE)
+            counts[std::make_pair(index, offset)]++;
+    }
+    DisplayObject::m.unlock_shared();
+}
@@ -0,0 +1,141 @@
+/*
+ * Copyright (C) 2014 SINTEF ICT,
+ * Applied Mathematics, Norway.
+ *
+ * Contact information:
+ * E-mail: eivind.fonn@sintef.no
+ * SINTEF ICT, Department of Applied Mathematics,
+ * P.O. Box 4760 Sluppen,
+ * 7045 Trondheim, Norway.
+ *
+ * This file is part of BSGUI.
+ *
+ * BSGUI is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * BSGUI is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public
+ * License along with GoTools. If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In accordance with Section 7(b) of the GNU Affero General Public
+ * License, a covered work must retain the producer line in every data
+ * file that is created or manipulated using GoTools.
+ *
+ * Other Usage
+ * You can be released from the requirements of the license by purchasing
+ * a commercial license. Buying such a license is mandatory as soon as you
+ * develop commercial activities involving the GoTools library without
+ * disclosing the source code of your own applications.
+ *
+ * This file may be used in accordance with the terms contained in a
+ * written agreement between you and SINTEF ICT.
+ */
+
+#include <condition_variable>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <vector>
+
+#include <QMatrix4x4>
+#include <QObject>
+
+#include "DisplayObject.h"
+
+#ifndef _RAYPICKER_H_
+#define _RAYPICKER_H_
+
+//! The largest number of rays cast for one pick. Larger rectangles are sampled sparsely.
+#define RAYPICKER_MAX_RAYS 65536
+
+//! \brief Picks components on the CPU, by casting rays through the pixels of a rectangle.
+//!
+//! This is an alternative to the picking pass of GLWidget, and finds the same (index, offset)
+//! pairs without an OpenGL context, by way of DisplayObject::raycastAll(). The rows of a pick are
+//! shared between a number of worker threads, which hold DisplayObject::m shared while casting a
+//! row, so they run in parallel with each other, and only hold up writers for a row at a time.
+//! When all rows are done, finished() is emitted, and the result can be collected.
+//!
+//! Before the rows are cast, one worker regenerates the geometry released in low memory mode
+//! (see DisplayObject::setLowMemory()) of the objects reaching into the rectangle. The
+//! regenerated geometry is dropped when the pick is done.
+class RayPicker : public QObject
+{
+    Q_OBJECT
+
+public:
+    RayPicker(QObject *parent = NULL);
+    ~RayPicker();
+
+    //! \brief Starts picking a rectangle, superseding any pick in progress.
+    //!
+    //! \param mvp The model-view-projection matrix of the view.
+    //! \param width The width of the view in pixels.
+    //! \param height The height of the view in pixels.
+    //! \param x, y, w, h The rectangle, in pixels from the lower left corner.
+    //! \param mode The selection mode.
+    void pick(const QMatrix4x4 &mvp, int width, int height, int x, int y, int w, int h,
+              SelectionMode mode);
+
+    //! \brief Collects the result of the last finished pick. Returns false if there is none.
+    bool result(std::set<std::pair<uint,uint>> *picks);
+
+signals:
+    //! Emitted from a worker thread when a pick is done.
+    void finished();
+
+private:
+    //! The parameters of a pick.
+    struct Job
+    {
+        QMatrix4x4 inverse;
+        int width, height, x, y, w, h, stride;
+        SelectionMode mode;
+
+        //! \brief The model-view-projection matrix mapping the rectangle, grown by the width that
+        //! edges can be hit within, to the whole view. Its frustum bounds the rays.
+        QMatrix4x4 region;
+    };
+
+    void work();
+
+    //! Regenerates the released geometry that the rays of a pick may hit.
+    static void regenerate(const Job &job, RegeneratedGeometry *regenerated);
+
+    //! Casts the rays of a row of a pick, and adds the hits to \a counts.
+    static void castRow(const Job &job, uint row, const RegeneratedGeometry &regenerated,
+                        std::map<std::pair<uint,uint>, uint> &counts);
+
+    std::vector<std::thread> workers;
+    std::mutex m;
+    std::condition_variable jobChanged;
+    bool running;
+
+    //! Increases with each pick, so that rows of superseded picks are dropped.
+    uint generation;
+
+    Job job;
+    uint nextRow, doneRows, rows;
+
+    //! \brief The regenerated geometry of the current pick, or NULL until a worker has made it.
+    //! Workers casting rows hold on to it, so a new pick can replace it at any time.
+    std::shared_ptr<const RegeneratedGeometry> regenerated;
+    bool regenerating;
+
+    //! The number of rays hitting each (index, offset) pair so far.
+    std::map<std::pair<uint,uint>, uint> counts;
+
+    bool ready;
+    std::set<std::pair<uint,uint>> picks;
+};
+
+#endif /* _RAYPICKER_H_ */
@@ -0,0 +1,81 @@
+/*
+ * Copyright (C) 2014 SINTEF ICT,
+ * Applied Mathematics, Norway.
+ *
+ * Contact information:
+ * E-mail: eivind.fonn@sintef.no
+ * SINTEF ICT, Department of Applied Mathematics,
+ * P.O. Box 4760 Sluppen,
+ * 7045 Trondheim, Norway.
+ *
+ * This file is part of BSGUI.
+ *
+ * BSGUI is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * BSGUI is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public
+ * License along with GoTools. If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In accordance with Section 7(b) of the GNU Affero General Public
+ * License, a covered work must retain the producer line in every data
+ * file that is created or manipulated using GoTools.
+ *
+ * Other Usage
+ * You can be released from the requirements of the license by purchasing
+ * a commercial license. Buying such a license is mandatory as soon as you
+ * develop commercial activities involving the GoTools library without
+ * disclosing the source code of your own applications.
+ *
+ * This file may be used in accordance with the terms contained in a
+ * written agreement between you and SINTEF ICT.
+ */
+
+#include <condition_variable>
+#include <mutex>
+
+#ifndef _SHAREDMUTEX_H_
+#define _SHAREDMUTEX_H_
+
+typedef unsigned int uint;
+
+//! \brief A mutex that can be held by one writer or by any number of readers.
+//!
+//! The exclusive methods lock(), try_lock() and unlock() make it a drop-in replacement for
+//! std::mutex, also with std::lock(). Readers use lock_shared() and unlock_shared(). A waiting
+//! writer keeps new readers out, so a steady stream of readers can't starve it.
+class SharedMutex
+{
+public:
+    SharedMutex();
+
+    //! Locks the mutex for writing, waiting for the current writer or readers to finish.
+    void lock();
+
+    //! Locks the mutex for writing if it is free, and returns whether it was.
+    bool try_lock();
+
+    //! Unlocks the mutex after lock() or a successful try_lock().
+    void unlock();
+
+    //! Locks the mutex for reading, waiting for the current and waiting writers to finish.
+    void lock_shared();
+
+    //! Unlocks the mutex after lock_shared().
+    void unlock_shared();
+
+private:
+    std::mutex m;
+    std::condition_variable changed;
+    uint readers, waitingWriters;
+    bool writer;
+};
+
+#endif /* _SHAREDMUTEX_H_ */
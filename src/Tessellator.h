@@ -0,0 +1,663 @@
+/*
+ * Copyright (C) 2014 SINTEF ICT,
+ * Applied Mathematics, Norway.
+ *
+ * Contact information:
+ * E-mail: eivind.fonn@sintef.no
+ * SINTEF ICT, Department of Applied Mathematics,
+ * P.O. Box 4760 Sluppen,
+ * 7045 Trondheim, Norway.
+ *
+ * This file is part of BSGUI.
+ *
+ * BSGUI is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * BSGUI is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public
+ * License along with GoTools. If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In accordance with Section 7(b) of the GNU Affero General Public
+ * License, a covered work must retain the producer line in every data
+ * file that is created or manipulated using GoTools.
+ *
+ * Other Usage
+ * You can be released from the requirements of the license by purchasing
+ * a commercial license. Buying such a license is mandatory as soon as you
+ * develop commercial activities involving the GoTools library without
+ * disclosing the source code of your own applications.
+ *
+ * This file may be used in accordance with the terms contained in a
+ * written agreement between you and SINTEF ICT.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include <QVector3D>
+
+#include "DisplayObject.h"
+
+#ifndef _TESSELLATOR_H_
+#define _TESSELLATOR_H_
+
+//! The number of knot spans in each direction of a Tile.
+#define TESSELLATOR_TILE_SPANS 8
+
+//! The maximal number of quads along each triangle strip.
+#define TESSELLATOR_STRIP_WIDTH 16
+
+//! \brief Tessellation engine for tensor product patches of parametric dimension \a D (1, 2 or 3).
+//!
+//! A patch is sampled uniformly with a given refinement in each knot span, and the engine
+//! produces the data described in \ref DisplayObjectSubclassing: vertices, faces, element lines,
+//! edges and points, together with their index bounds. The numbering below is the one of the
+//! Topology tables.
+//!
+//! The components are ordered consistently for all dimensions:
+//!
+//! - **Points** are the corners of the parameter domain. Point \a k has coordinate direction
+//!   \a d at the upper end if bit \a d of \a k is set.
+//! - **Edges** are ordered by direction, and then by the position of the remaining directions,
+//!   lowest direction first, as in the point numbering.
+//! - **Faces** are the patch itself for surfaces, and the boundary faces for volumes, ordered
+//!   with the fixed direction descending (w, v, u) and the lower end first.
+//!
+//! Vertices are owned by *sheets*, which are the faces for surfaces and volumes, and the single
+//! edge for curves. Each sheet has its own grid, so where faces of a volume meet, every face has
+//! a copy of the vertices there, and the strips and element lines of a face only use its own
+//! vertices (see Tessellation::faceData). The copies take the position and the averaged normal
+//! of the first face containing the point, whose copy is also the one used by edges and points.
+//!
+//! Each face is split into tiles of #TESSELLATOR_TILE_SPANS knot spans in each direction (fewer at
+//! the upper ends). The tiles don't depend on the refinement, so a patch has the same tiles at
+//! every quality, and only their bounds change. The triangle strips and element lines of a face
+//! are stored tile by tile, so that each Tile is a contiguous range, and the face is still the
+//! union of its tiles.
+//!
+//! Within a tile, the quads are grouped in bands of at most #TESSELLATOR_STRIP_WIDTH columns, and
+//! each row of a band is a triangle strip terminated by #PRIMITIVE_RESTART. The strips of a band
+//! are emitted row by row, so that a strip reuses the vertices of the previous one while they are
+//! still in the post-transform cache. The vertices are then renumbered in order of first use.
+//!
+//! Adding a new patch type amounts to computing the knots and refinement factors, and providing
+//! an evaluator for each sheet to mkVertexData().
+template <uint D>
+class Tessellator
+{
+public:
+    //! Describes a sheet: the running directions \a s and \a t, and the fixed direction \a f (or
+    //! -1 if there is none) with its position.
+    struct Sheet
+    {
+        uint s, t;
+        int f;
+        bool pos;
+    };
+
+    static constexpr uint nFaces() { return D == 3 ? 6 : (D == 2 ? 1 : 0); }
+    static constexpr uint nEdges() { return D << (D - 1); }
+    static constexpr uint nPoints() { return 1 << D; }
+    static constexpr uint nSheets() { return D == 1 ? 1 : nFaces(); }
+
+    //! \brief Constructs the tessellation layout.
+    //!
+    //! \param knots The knot vectors (without multiplicity) in each direction.
+    //! \param ref The number of samples in each knot span in each direction.
+    Tessellator(const std::vector<double> (&knots)[D], const uint (&ref)[D]);
+
+    //! Returns the description of a sheet.
+    static Sheet sheet(uint i);
+
+    //! Returns the number of samples per knot span for a base refinement scaled by a quality factor.
+    static inline uint refinement(uint base, float quality)
+    {
+        return std::max(1, (int) std::round(base * quality));
+    }
+
+    //! Returns the total number of vertices.
+    inline uint nVertices() const { return _nVertices; }
+
+    //! Returns the sample parameters in direction \a d.
+    inline const std::vector<double> &params(uint d) const { return _params[d]; }
+
+    //! \brief Fills in the vertices and normals.
+    //!
+    //! \param evaluate Called once per sheet as `evaluate(sheet, sParams, tParams, points, du, dv)`,
+    //! and should produce a grid of points and partial derivatives (three components each, \a s
+    //! running fastest), like BasisCache::gridEvaluator. For curves, \a tParams is empty and the
+    //! derivatives are ignored.
+    template <typename F>
+    void mkVertexData(std::vector<QVector3D> &vertices, std::vector<QVector3D> &normals, F evaluate) const;
+
+    void mkFaceData(std::vector<GLuint> &data, std::vector<uint> &idxs) const;
+    void mkElementData(std::vector<pair> &data, std::vector<uint> &idxs) const;
+    void mkEdgeData(std::vector<pair> &data, std::vector<uint> &idxs) const;
+    void mkPointData(std::vector<GLuint> &data) const;
+
+    //! \brief Fills in the tiles, using the vertices from mkVertexData() and the index bounds
+    //! from mkFaceData() and mkElementData().
+    void mkTileData(std::vector<Tile> &tiles, const std::vector<QVector3D> &vertices,
+                    const std::vector<uint> &faceIdxs, const std::vector<uint> &elementIdxs) const;
+
+    //! \brief Renumbers the vertices in order of first use in Tessellation::faceData, updating all
+    //! the index data. Vertices not used by any face keep their relative order at the end.
+    static void optimizeVertexOrder(Tessellation &out);
+
+    //! \brief Simplifies a curve tessellation with the Douglas-Peucker algorithm. Only for D = 1.
+    //!
+    //! Removes vertices so that the polyline deviates by at most \a tolerance times the size of
+    //! the curve (the diagonal of its bounding box) from the original samples. The endpoints are
+    //! always kept, so #Tessellation::pointData stays exact.
+    static void simplify(Tessellation &out, float tolerance);
+
+    //! \brief Fills in all the tessellation data of \a out.
+    //!
+    //! \param evaluate As in mkVertexData().
+    template <typename F>
+    void tessellate(Tessellation &out, F evaluate) const;
+
+private:
+    uint nt[3]; //!< Knot spans in each direction.
+    uint r[3];  //!< Samples per knot span in each direction.
+    uint n[3];  //!< Segments in each direction.
+
+    uint _nVertices;
+    uint vertexBase[6];
+    std::vector<double> _params[3];
+
+    //! Returns the coordinates of the lower corner of a sheet.
+    void sheetCorner(const Sheet &sh, uint (&c)[3]) const;
+
+    //! Utility function that refines a vector *knot* of knot values by inserting *ref*
+    //! points in each element, storing the results in *params*.
+    static void mkSamples(const std::vector<double> &knots, std::vector<double> &params, uint ref);
+
+    //! \brief Returns the vertex index of a point on the boundary, given by its grid coordinates.
+    //! This is the copy in the first sheet containing the point.
+    uint vertex(const uint (&c)[3]) const;
+
+    //! Returns the index of the copy of a vertex in a sheet, given by its local grid coordinates.
+    inline uint vertex(const Sheet &sh, uint i, uint j) const
+    {
+        uint k = D < 3 ? 0 : 2 * (2 - sh.f) + (sh.pos ? 1 : 0);
+        return vertexBase[k] + i + (n[sh.s] + 1) * j;
+    }
+
+    //! Returns the index of the first copy of a vertex, given by its local grid coordinates in a sheet.
+    inline uint owner(const Sheet &sh, uint i, uint j) const
+    {
+        uint c[3];
+        sheetCorner(sh, c);
+        c[sh.s] = i;
+        if (D > 1)
+            c[sh.t] = j;
+        return vertex(c);
+    }
+
+    //! Returns the number of entries in Tessellation::faceData of a tile with \a w × \a h quads.
+    static inline uint stripIndices(uint w, uint h)
+    {
+        uint full = w / TESSELLATOR_STRIP_WIDTH, rest = w % TESSELLATOR_STRIP_WIDTH;
+        return h * (full * (2 * TESSELLATOR_STRIP_WIDTH + 3) + (rest ? 2 * rest + 3 : 0));
+    }
+
+    //! Returns the direction and the corner coordinates of an edge.
+    void edge(uint k, uint *d, uint (&c)[3]) const;
+
+    //! \brief Calls `f(s0, s1, t0, t1)` for each tile of a sheet, in storage order, where the
+    //! tile covers the knot spans [\a s0, \a s1) × [\a t0, \a t1).
+    template <typename F>
+    void forEachTile(const Sheet &sh, F f) const;
+};
+
+
+template <uint D>
+Tessellator<D>::Tessellator(const std::vector<double> (&knots)[D], const uint (&ref)[D])
+{
+    for (uint d = 0; d < 3; d++)
+    {
+        nt[d] = d < D ? knots[d].size() - 1 : 0;
+        r[d] = d < D ? ref[d] : 1;
+        if (d < D)
+            mkSamples(knots[d], _params[d], r[d]);
+        n[d] = nt[d] * r[d];
+    }
+
+    if (D < 3)
+    {
+        vertexBase[0] = 0;
+        _nVertices = (n[0] + 1) * (n[1] + 1);
+        return;
+    }
+
+    _nVertices = 0;
+    for (uint i = 0; i < nSheets(); i++)
+    {
+        Sheet sh = sheet(i);
+        vertexBase[i] = _nVertices;
+        _nVertices += (n[sh.s] + 1) * (n[sh.t] + 1);
+    }
+}
+
+
+template <uint D>
+typename Tessellator<D>::Sheet Tessellator<D>::sheet(uint i)
+{
+    if (D < 3)
+        return { 0, 1, -1, false };
+
+    int f = 2 - i/2;
+    return { f == 0 ? 1u : 0u, f == 2 ? 1u : 2u, f, i % 2 == 1 };
+}
+
+
+template <uint D>
+template <typename F>
+void Tessellator<D>::mkVertexData(std::vector<QVector3D> &vertices, std::vector<QVector3D> &normals,
+                                  F evaluate) const
+{
+    vertices.assign(_nVertices, QVector3D());
+    normals.assign(_nVertices, QVector3D());
+
+    std::vector<double> points, du, dv;
+
+    for (uint k = 0; k < nSheets(); k++)
+    {
+        Sheet sh = sheet(k);
+        evaluate(k, _params[sh.s], _params[sh.t], points, du, dv);
+
+        // Outward normals for volumes depend on the orientation of the face
+        float sign = (D < 3) ? 1.0 : (sh.pos ? 1.0 : -1.0) * (sh.f == 1 ? -1.0 : 1.0);
+
+        uint nI = n[sh.s] + 1, nJ = D > 1 ? n[sh.t] + 1 : 1;
+        for (uint j = 0; j < nJ; j++)
+            for (uint i = 0; i < nI; i++)
+            {
+                uint idx = nI * j + i, v = vertex(sh, i, j);
+                vertices[v] = QVector3D(points[3*idx], points[3*idx+1], points[3*idx+2]);
+
+                // Normals are summed in the first copy, so they are averaged where faces meet
+                if (D > 1)
+                {
+                    const double *a = &du[3*idx], *b = &dv[3*idx];
+                    QVector3D norm(a[1]*b[2] - a[2]*b[1], a[2]*b[0] - a[0]*b[2], a[0]*b[1] - a[1]*b[0]);
+                    normals[owner(sh, i, j)] += sign * norm.normalized();
+                }
+            }
+    }
+
+    // The other copies follow the first one, so the faces meet without cracks
+    if (D == 3)
+        for (uint k = 0; k < nSheets(); k++)
+        {
+            Sheet sh = sheet(k);
+            for (uint j = 0; j <= n[sh.t]; j++)
+                for (uint i = 0; i <= n[sh.s]; i++)
+                {
+                    uint v = vertex(sh, i, j), o = owner(sh, i, j);
+                    vertices[v] = vertices[o];
+                    normals[v] = normals[o];
+                }
+        }
+}
+
+
+template <uint D>
+template <typename F>
+void Tessellator<D>::tessellate(Tessellation &out, F evaluate) const
+{
+    mkVertexData(out.vertexData, out.normalData, evaluate);
+    mkFaceData(out.faceData, out.faceIdxs);
+    mkElementData(out.elementData, out.elementIdxs);
+    mkEdgeData(out.edgeData, out.edgeIdxs);
+    mkPointData(out.pointData);
+    mkTileData(out.tiles, out.vertexData, out.faceIdxs, out.elementIdxs);
+
+    if (nFaces() > 0)
+        optimizeVertexOrder(out);
+}
+
+
+template <uint D>
+void Tessellator<D>::mkFaceData(std::vector<GLuint> &data, std::vector<uint> &idxs) const
+{
+    idxs.resize(nFaces() + 1);
+    idxs[0] = 0;
+    for (uint k = 0; k < nFaces(); k++)
+    {
+        Sheet sh = sheet(k);
+        uint rS = r[sh.s], rT = r[sh.t];
+        idxs[k+1] = idxs[k];
+        forEachTile(sh, [&] (uint s0, uint s1, uint t0, uint t1) {
+            idxs[k+1] += stripIndices(rS * (s1 - s0), rT * (t1 - t0));
+        });
+    }
+
+    data.resize(idxs.back());
+    for (uint k = 0; k < nFaces(); k++)
+    {
+        Sheet sh = sheet(k);
+        uint rS = r[sh.s], rT = r[sh.t], pos = idxs[k];
+
+        forEachTile(sh, [&] (uint s0, uint s1, uint t0, uint t1) {
+            for (uint b0 = rS*s0; b0 < rS*s1; b0 += TESSELLATOR_STRIP_WIDTH)
+            {
+                uint b1 = std::min(b0 + TESSELLATOR_STRIP_WIDTH, rS*s1);
+                for (uint j = rT*t0; j < rT*t1; j++)
+                {
+                    // Counter-clockwise in (s,t), like the quad (i,j), (i+1,j), (i+1,j+1), (i,j+1)
+                    for (uint i = b0; i <= b1; i++)
+                    {
+                        data[pos++] = vertex(sh, i, j+1);
+                        data[pos++] = vertex(sh, i, j);
+                    }
+                    data[pos++] = PRIMITIVE_RESTART;
+                }
+            }
+        });
+    }
+}
+
+
+template <uint D>
+void Tessellator<D>::mkElementData(std::vector<pair> &data, std::vector<uint> &idxs) const
+{
+    idxs.resize(nFaces() + 1);
+    idxs[0] = 0;
+    for (uint k = 0; k < nFaces(); k++)
+    {
+        Sheet sh = sheet(k);
+        idxs[k+1] = idxs[k] + n[sh.s] * (nt[sh.t] - 1) + n[sh.t] * (nt[sh.s] - 1);
+    }
+
+    data.resize(idxs.back());
+    for (uint k = 0; k < nFaces(); k++)
+    {
+        Sheet sh = sheet(k);
+        uint rS = r[sh.s], rT = r[sh.t], pos = idxs[k];
+
+        // Lines running along s at the interior knots in t, then vice versa. A tile owns the knot
+        // lines at its lower boundary, but not at its upper one.
+        forEachTile(sh, [&] (uint s0, uint s1, uint t0, uint t1) {
+            for (uint j = std::max(t0, 1u); j < t1; j++)
+                for (uint i = rS*s0; i < rS*s1; i++)
+                    data[pos++] = { vertex(sh, i, rT*j), vertex(sh, i+1, rT*j) };
+
+            for (uint j = std::max(s0, 1u); j < s1; j++)
+                for (uint i = rT*t0; i < rT*t1; i++)
+                    data[pos++] = { vertex(sh, rS*j, i), vertex(sh, rS*j, i+1) };
+        });
+    }
+}
+
+
+template <uint D>
+void Tessellator<D>::mkEdgeData(std::vector<pair> &data, std::vector<uint> &idxs) const
+{
+    uint c[3], d;
+
+    idxs.resize(nEdges() + 1);
+    idxs[0] = 0;
+    for (uint k = 0; k < nEdges(); k++)
+    {
+        edge(k, &d, c);
+        idxs[k+1] = idxs[k] + n[d];
+    }
+
+    data.resize(idxs.back());
+    for (uint k = 0; k < nEdges(); k++)
+    {
+        edge(k, &d, c);
+        for (uint i = 0; i < n[d]; i++)
+        {
+            c[d] = i;
+            GLuint a = vertex(c);
+            c[d] = i + 1;
+            data[idxs[k] + i] = { a, vertex(c) };
+        }
+    }
+}
+
+
+template <uint D>
+void Tessellator<D>::mkPointData(std::vector<GLuint> &data) const
+{
+    data.resize(nPoints());
+    for (uint k = 0; k < nPoints(); k++)
+    {
+        uint c[3];
+        for (uint d = 0; d < 3; d++)
+            c[d] = (k & (1 << d)) ? n[d] : 0;
+        data[k] = vertex(c);
+    }
+}
+
+
+template <uint D>
+void Tessellator<D>::mkTileData(std::vector<Tile> &tiles, const std::vector<QVector3D> &vertices,
+                                const std::vector<uint> &faceIdxs, const std::vector<uint> &elementIdxs) const
+{
+    tiles.clear();
+    for (uint k = 0; k < nFaces(); k++)
+    {
+        Sheet sh = sheet(k);
+        uint rS = r[sh.s], rT = r[sh.t], facePos = faceIdxs[k], elementPos = elementIdxs[k];
+
+        forEachTile(sh, [&] (uint s0, uint s1, uint t0, uint t1) {
+            Tile tile;
+            tile.face = k;
+
+            tile.faceBegin = facePos;
+            facePos += stripIndices(rS * (s1 - s0), rT * (t1 - t0));
+            tile.faceEnd = facePos;
+
+            tile.elementBegin = elementPos;
+            elementPos += ((t1 - std::max(t0, 1u)) * rS * (s1 - s0) +
+                           (s1 - std::max(s0, 1u)) * rT * (t1 - t0));
+            tile.elementEnd = elementPos;
+
+            // Bounding sphere around the center of the bounding box
+            QVector3D lo = vertices[vertex(sh, rS*s0, rT*t0)], hi = lo;
+            for (uint j = rT*t0; j <= rT*t1; j++)
+                for (uint i = rS*s0; i <= rS*s1; i++)
+                {
+                    const QVector3D &p = vertices[vertex(sh, i, j)];
+                    lo = QVector3D(std::min(lo.x(), p.x()), std::min(lo.y(), p.y()), std::min(lo.z(), p.z()));
+                    hi = QVector3D(std::max(hi.x(), p.x()), std::max(hi.y(), p.y()), std::max(hi.z(), p.z()));
+                }
+
+            tile.center = (lo + hi) / 2;
+            tile.radius = 0.0;
+            for (uint j = rT*t0; j <= rT*t1; j++)
+                for (uint i = rS*s0; i <= rS*s1; i++)
+                    tile.radius = std::max(tile.radius, (vertices[vertex(sh, i, j)] - tile.center).length());
+
+            tiles.push_back(tile);
+        });
+    }
+}
+
+
+template <uint D>
+void Tessellator<D>::mkSamples(const std::vector<double> &knots, std::vector<double> &params, uint ref)
+{
+    params.resize((knots.size() - 1) * ref + 1);
+
+    for (uint i = 0; i < knots.size() - 1; i++)
+        for (uint j = 0; j < ref; j++)
+            params[i*ref + j] = knots[i] + (double) j / ref * (knots[i+1] - knots[i]);
+    params.back() = knots.back();
+}
+
+
+template <uint D>
+void Tessellator<D>::sheetCorner(const Sheet &sh, uint (&c)[3]) const
+{
+    c[0] = c[1] = c[2] = 0;
+    if (sh.f >= 0 && sh.pos)
+        c[sh.f] = n[sh.f];
+}
+
+
+template <uint D>
+uint Tessellator<D>::vertex(const uint (&c)[3]) const
+{
+    if (D < 3)
+        return c[0] + (n[0] + 1) * c[1];
+
+    // The owner is the first face containing the point, i.e. the one with the highest fixed
+    // direction where the point is on the boundary
+    int f = (c[2] == 0 || c[2] == n[2]) ? 2 : ((c[1] == 0 || c[1] == n[1]) ? 1 : 0);
+    Sheet sh = sheet(2 * (2 - f) + (c[f] != 0 ? 1 : 0));
+    return vertex(sh, c[sh.s], c[sh.t]);
+}
+
+
+template <uint D>
+void Tessellator<D>::edge(uint k, uint *d, uint (&c)[3]) const
+{
+    const uint nOther = 1 << (D - 1);
+    *d = k / nOther;
+
+    uint rest = k % nOther, b = 0;
+    for (uint e = 0; e < 3; e++)
+    {
+        c[e] = 0;
+        if (e == *d || e >= D)
+            continue;
+        if (rest & (1 << b))
+            c[e] = n[e];
+        b++;
+    }
+}
+
+template <uint D>
+void Tessellator<D>::optimizeVertexOrder(Tessellation &out)
+{
+    uint nV = out.vertexData.size();
+    std::vector<GLuint> remap(nV, PRIMITIVE_RESTART);
+
+    GLuint next = 0;
+    for (auto v : out.faceData)
+        if (v != PRIMITIVE_RESTART && remap[v] == PRIMITIVE_RESTART)
+            remap[v] = next++;
+    for (uint v = 0; v < nV; v++)
+        if (remap[v] == PRIMITIVE_RESTART)
+            remap[v] = next++;
+
+    std::vector<QVector3D> vertices(nV), normals(out.normalData.size());
+    for (uint v = 0; v < nV; v++)
+    {
+        vertices[remap[v]] = out.vertexData[v];
+        if (!normals.empty())
+            normals[remap[v]] = out.normalData[v];
+    }
+    out.vertexData.swap(vertices);
+    out.normalData.swap(normals);
+
+    for (auto &v : out.faceData)
+        if (v != PRIMITIVE_RESTART)
+            v = remap[v];
+    for (auto &l : out.elementData)
+        l = { remap[l.a], remap[l.b] };
+    for (auto &l : out.edgeData)
+        l = { remap[l.a], remap[l.b] };
+    for (auto &v : out.pointData)
+        v = remap[v];
+}
+
+
+template <uint D>
+void Tessellator<D>::simplify(Tessellation &out, float tolerance)
+{
+    static_assert(D == 1, "Only curves can be simplified");
+
+    std::vector<QVector3D> &pts = out.vertexData;
+    uint nPts = pts.size();
+    if (tolerance <= 0.0 || nPts <= 2)
+        return;
+
+    QVector3D lo = pts[0], hi = pts[0];
+    for (auto &p : pts)
+    {
+        lo = QVector3D(std::min(lo.x(), p.x()), std::min(lo.y(), p.y()), std::min(lo.z(), p.z()));
+        hi = QVector3D(std::max(hi.x(), p.x()), std::max(hi.y(), p.y()), std::max(hi.z(), p.z()));
+    }
+    float tol = tolerance * (hi - lo).length();
+
+    // Iterative Douglas-Peucker, splitting at the farthest sample until all are within tolerance
+    std::vector<bool> keep(nPts, false);
+    keep[0] = keep[nPts-1] = true;
+
+    std::vector<std::pair<uint, uint>> stack = { { 0, nPts - 1 } };
+    while (!stack.empty())
+    {
+        uint a = stack.back().first, b = stack.back().second;
+        stack.pop_back();
+
+        QVector3D dir = pts[b] - pts[a];
+        float len = dir.length();
+        if (len > 0)
+            dir /= len;
+
+        uint split = a;
+        float dist = tol;
+        for (uint i = a + 1; i < b; i++)
+        {
+            QVector3D v = pts[i] - pts[a];
+            float d = (len > 0 ? v - QVector3D::dotProduct(v, dir) * dir : v).length();
+            if (d > dist)
+            {
+                dist = d;
+                split = i;
+            }
+        }
+
+        if (split != a)
+        {
+            keep[split] = true;
+            stack.push_back({ a, split });
+            stack.push_back({ split, b });
+        }
+    }
+
+    uint m = 0;
+    for (uint i = 0; i < nPts; i++)
+        if (keep[i])
+        {
+            pts[m] = pts[i];
+            out.normalData[m] = out.normalData[i];
+            m++;
+        }
+    pts.resize(m);
+    out.normalData.resize(m);
+
+    out.edgeData.resize(m - 1);
+    for (uint i = 0; i < m - 1; i++)
+        out.edgeData[i] = { i, i + 1 };
+    out.edgeIdxs = { 0, m - 1 };
+    out.pointData = { 0, m - 1 };
+}
+
+
+template <uint D>
+template <typename F>
+void Tessellator<D>::forEachTile(const Sheet &sh, F f) const
+{
+    const uint n = TESSELLATOR_TILE_SPANS;
+
+    for (uint t0 = 0; t0 < nt[sh.t]; t0 += n)
+        for (uint s0 = 0; s0 < nt[sh.s]; s0 += n)
+            f(s0, std::min(s0 + n, nt[sh.s]), t0, std::min(t0 + n, nt[sh.t]));
+}
+
+#endif /* _TESSELLATOR_H_ */
@@ -113,6 +113,42 @@ TreePanel::TreePanel(GLWidget *glWidget, ObjectSet *objectSet, QWidget *filter,
                          pointsBtn->setChecked(mode == SM_POINT);
                      });
 
+
+    QGroupBox *qualityPanel = new QGroupBox("Tessellation quality");
+    layout->addWidget(qualityPanel);
+    QGridLayout *qualityLayout = new QGridLayout();
+    qualityPanel->setLayout(qualityLayout);
+
+    QDoubleSpinBox *quality = new QDoubleSpinBox();
+    quality->setRange(0.1, 4.0);
+    quality->setSingleStep(0.1);
+    quality->setDecimals(1);
+    quality->setValue(objectSet->quality());
+    qualityLayout->addWidget(quality, 0, 0, 1, 2);
+
+    QPushButton *qualityAllBtn = new QPushButton("Apply to all");
+    qualityLayout->addWidget(qualityAllBtn, 1, 0, 1, 1);
+
+    QPushButton *qualitySelBtn = new QPushButton("Apply to selection");
+    qualityLayout->addWidget(qualitySelBtn, 1, 1, 1, 1);
+
+    QObject::connect(qualityAllBtn, &QPushButton::clicked,
+                     [objectSet, quality] () { objectSet->setQuality(quality->value(), false); });
+    QObject::connect(qualitySelBtn, &QPushButton::clicked,
+                     [objectSet, quality] () { objectSet->setQuality(quality->value(), true); });
+
+    qualityLayout->addWidget(new QLabel("Curve tolerance"), 2, 0, 1, 1);
+    QDoubleSpinBox *tolerance = new QDoubleSpinBox();
+    tolerance->setRange(0.0, 0.1);
+    tolerance->setSingleStep(0.0001);
+    tolerance->setDecimals(4);
+    tolerance->setValue(objectSet->curveTolerance());
+    tolerance->setKeyboardTracking(false);
+    qualityLayout->addWidget(tolerance, 2, 1, 1, 1);
+
+    QObject::connect(tolerance, static_cast<void (QDoubleSpinBox::*)(double)>(&QDoubleSpinBox::valueChanged),
+                     [objectSet] (double val) { objectSet->setCurveTolerance(val); });
+
     setLayout(layout);
 }
 
@@ -367,6 +403,61 @@ CameraPanel::CameraPanel(GLWidget *glWidget, ObjectSet *objectSet,
     row++;
 
 
+    compactBuffers = new QCheckBox("Compact buffers");
+    compactBuffers->setToolTip("Store vertices in a quantized format using less GPU memory");
+    layout->addWidget(compactBuffers, row, 0, 1, 3);
+    compactBuffers->setChecked(glWidget->compactBuffers());
+
+    QObject::connect(compactBuffers, &QCheckBox::toggled,
+                     [glWidget] (bool checked) { glWidget->setCompactBuffers(checked); });
+
+    row++;
+
+
+    lowMemory = new QCheckBox("Low memory mode");
+    lowMemory->setToolTip("Release tessellations from main memory once they are on the GPU");
+    layout->addWidget(lowMemory, row, 0, 1, 3);
+    lowMemory->setChecked(glWidget->lowMemory());
+
+    QObject::connect(lowMemory, &QCheckBox::toggled,
+                     [glWidget] (bool checked) { glWidget->setLowMemory(checked); });
+
+    row++;
+
+
+    occlusionCulling = new QCheckBox("Occlusion culling");
+    occlusionCulling->setToolTip("Skip patches hidden behind others");
+    layout->addWidget(occlusionCulling, row, 0, 1, 3);
+    occlusionCulling->setChecked(glWidget->occlusionCulling());
+
+    QObject::connect(occlusionCulling, &QCheckBox::toggled,
+                     [glWidget] (bool checked) { glWidget->setOcclusionCulling(checked); });
+
+    row++;
+
+
+    rayPicking = new QCheckBox("Ray picking");
+    rayPicking->setToolTip("Pick by casting rays on the CPU, without drawing the scene");
+    layout->addWidget(rayPicking, row, 0, 1, 3);
+    rayPicking->setChecked(glWidget->rayPicking());
+
+    QObject::connect(rayPicking, &QCheckBox::toggled,
+                     [glWidget] (bool checked) { glWidget->setRayPicking(checked); });
+
+    row++;
+
+
+    xraySelection = new QCheckBox("X-ray selection");
+    xraySelection->setToolTip("Select everything inside the rectangle, also what is hidden behind");
+    layout->addWidget(xraySelection, row, 0, 1, 3);
+    xraySelection->setChecked(glWidget->xraySelection());
+
+    QObject::connect(xraySelection, &QCheckBox::toggled,
+                     [glWidget] (bool checked) { glWidget->setXraySelection(checked); });
+
+    row++;
+
+
     QObject::connect(glWidget, &GLWidget::fixedChanged, this, &CameraPanel::fixedChanged);
 
 
@@ -86,7 +86,8 @@ private:
     QDoubleSpinBox *lookAtX, *lookAtY, *lookAtZ;
 
     QRadioButton *perspectiveBtn, *orthographicBtn;
-    QCheckBox *showAxes, *showPoints;
+    QCheckBox *showAxes, *showPoints, *compactBuffers, *lowMemory, *occlusionCulling, *rayPicking,
+        *xraySelection;
 };
 
 
@@ -0,0 +1,101 @@
+/*
+ * Copyright (C) 2014 SINTEF ICT,
+ * Applied Mathematics, Norway.
+ *
+ * Contact information:
+ * E-mail: eivind.fonn@sintef.no
+ * SINTEF ICT, Department of Applied Mathematics,
+ * P.O. Box 4760 Sluppen,
+ * 7045 Trondheim, Norway.
+ *
+ * This file is part of BSGUI.
+ *
+ * BSGUI is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * BSGUI is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public
+ * License along with GoTools. If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In accordance with Section 7(b) of the GNU Affero General Public
+ * License, a covered work must retain the producer line in every data
+ * file that is created or manipulated using GoTools.
+ *
+ * Other Usage
+ * You can be released from the requirements of the license by purchasing
+ * a commercial license. Buying such a license is mandatory as soon as you
+ * develop commercial activities involving the GoTools library without
+ * disclosing the source code of your own applications.
+ *
+ * This file may be used in accordance with the terms contained in a
+ * written agreement between you and SINTEF ICT.
+ */
+
+#include "Topology.h"
+
+
+// The faces of a volume are ordered w, v, u, lower end first, and the edges by direction
+static constexpr uint volumeFaceStart[] = {0, 4, 8, 12, 16, 20, 24};
+static constexpr uint volumeFaceEdges[] = {0, 1, 4, 5,  2, 3, 6, 7,  0, 2, 8, 9,
+                                           1, 3, 10, 11,  4, 6, 8, 10,  5, 7, 9, 11};
+static constexpr uint volumeEdgeStart[] = {0, 2, 4, 6, 8, 10, 12, 14, 16, 18, 20, 22, 24};
+static constexpr uint volumeEdgePoints[] = {0, 1,  2, 3,  4, 5,  6, 7,  0, 2,  1, 3,
+                                            4, 6,  5, 7,  0, 4,  1, 5,  2, 6,  3, 7};
+static constexpr uint64_t volumeFaceEdgeMasks[] = {0x033, 0x0cc, 0x305, 0xc0a, 0x550, 0xaa0};
+static constexpr uint64_t volumeEdgePointMasks[] = {0x03, 0x0c, 0x30, 0xc0, 0x05, 0x0a,
+                                                    0x50, 0xa0, 0x11, 0x22, 0x44, 0x88};
+
+static constexpr uint surfaceFaceStart[] = {0, 4};
+static constexpr uint surfaceFaceEdges[] = {0, 1, 2, 3};
+static constexpr uint surfaceEdgeStart[] = {0, 2, 4, 6, 8};
+static constexpr uint surfaceEdgePoints[] = {0, 1,  2, 3,  0, 2,  1, 3};
+static constexpr uint64_t surfaceFaceEdgeMasks[] = {0xf};
+static constexpr uint64_t surfaceEdgePointMasks[] = {0x3, 0xc, 0x5, 0xa};
+
+static constexpr uint curveFaceStart[] = {0};
+static constexpr uint curveEdgeStart[] = {0, 2};
+static constexpr uint curveEdgePoints[] = {0, 1};
+static constexpr uint64_t curveEdgePointMasks[] = {0x3};
+
+static const Topology topologies[] = {
+    {6, 12, 8, volumeFaceStart, volumeFaceEdges, volumeEdgeStart, volumeEdgePoints,
+     volumeFaceEdgeMasks, volumeEdgePointMasks},
+    {1, 4, 4, surfaceFaceStart, surfaceFaceEdges, surfaceEdgeStart, surfaceEdgePoints,
+     surfaceFaceEdgeMasks, surfaceEdgePointMasks},
+    {0, 1, 2, curveFaceStart, nullptr, curveEdgeStart, curveEdgePoints,
+     nullptr, curveEdgePointMasks},
+};
+
+
+const Topology &Topology::of(ObjectType type)
+{
+    return topologies[type];
+}
+
+
+void Topology::expand(const uint64_t *masks, const ComponentSet &from, ComponentSet *to)
+{
+    uint64_t found = 0;
+    for (auto i : from)
+        found |= masks[i];
+    to->uniteWord(0, found);
+}
+
+
+void Topology::gather(uint n, const uint64_t *masks, const ComponentSet &from, bool all, ComponentSet *to)
+{
+    uint64_t members = from.word(0), found = 0;
+    for (uint i = 0; i < n; i++)
+    {
+        uint64_t hit = members & masks[i];
+        found |= (uint64_t) (all ? hit == masks[i] : hit != 0) << i;
+    }
+    to->uniteWord(0, found);
+}
@@ -0,0 +1,104 @@
+/*
+ * Copyright (C) 2014 SINTEF ICT,
+ * Applied Mathematics, Norway.
+ *
+ * Contact information:
+ * E-mail: eivind.fonn@sintef.no
+ * SINTEF ICT, Department of Applied Mathematics,
+ * P.O. Box 4760 Sluppen,
+ * 7045 Trondheim, Norway.
+ *
+ * This file is part of BSGUI.
+ *
+ * BSGUI is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * BSGUI is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public
+ * License along with GoTools. If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In accordance with Section 7(b) of the GNU Affero General Public
+ * License, a covered work must retain the producer line in every data
+ * file that is created or manipulated using GoTools.
+ *
+ * Other Usage
+ * You can be released from the requirements of the license by purchasing
+ * a commercial license. Buying such a license is mandatory as soon as you
+ * develop commercial activities involving the GoTools library without
+ * disclosing the source code of your own applications.
+ *
+ * This file may be used in accordance with the terms contained in a
+ * written agreement between you and SINTEF ICT.
+ */
+
+#include "ComponentSet.h"
+
+#ifndef _TOPOLOGY_H_
+#define _TOPOLOGY_H_
+
+typedef unsigned int uint;
+
+enum ObjectType { OT_VOLUME, OT_SURFACE, OT_CURVE };
+
+//! \brief The adjacency of the faces, edges and points of an object type, as compressed sparse
+//! rows.
+//!
+//! The components are numbered the same way for every object of a type (see Tessellator), so each
+//! type has a single constant table shared by all objects. The neighbours of component \a i are
+//! `adj[start[i]]` up to, but not including, `adj[start[i+1]]`.
+//!
+//! No type has more than 64 components of a kind, so the same rows are also stored as bitmasks,
+//! with bit \a j set if \a j is a neighbour. The selection routines work on these, a whole row
+//! at a time.
+struct Topology
+{
+    uint nFaces, nEdges, nPoints;
+    const uint *faceStart, *faceEdges;  //!< The edges around each face.
+    const uint *edgeStart, *edgePoints; //!< The end points of each edge.
+    const uint64_t *faceEdgeMasks;      //!< The edges around each face, as bitmasks.
+    const uint64_t *edgePointMasks;     //!< The end points of each edge, as bitmasks.
+
+    //! Returns the topology of an object type.
+    static const Topology &of(ObjectType type);
+
+    //! Adds the edges around the given faces to \a edges.
+    inline void edgesOf(const ComponentSet &faces, ComponentSet *edges) const
+    {
+        expand(faceEdgeMasks, faces, edges);
+    }
+
+    //! Adds the end points of the given edges to \a points.
+    inline void pointsOf(const ComponentSet &edges, ComponentSet *points) const
+    {
+        expand(edgePointMasks, edges, points);
+    }
+
+    //! Adds the faces with all (or, if \a all is false, any) of their edges among \a edges.
+    inline void facesWith(const ComponentSet &edges, bool all, ComponentSet *faces) const
+    {
+        gather(nFaces, faceEdgeMasks, edges, all, faces);
+    }
+
+    //! Adds the edges with both (or, if \a all is false, either) of their end points among \a points.
+    inline void edgesWith(const ComponentSet &points, bool all, ComponentSet *edges) const
+    {
+        gather(nEdges, edgePointMasks, points, all, edges);
+    }
+
+    //! Adds the neighbours of all members of \a from to \a to, given the rows as bitmasks.
+    static void expand(const uint64_t *masks, const ComponentSet &from, ComponentSet *to);
+
+    //! \brief Adds to \a to each of the \a n components with all (or any) of its neighbours in
+    //! \a from, given the rows as bitmasks. Each row is a single test against the first word of
+    //! \a from, and the results are collected into a word without branching.
+    static void gather(uint n, const uint64_t *masks, const ComponentSet &from, bool all, ComponentSet *to);
+};
+
+#endif /* _TOPOLOGY_H_ */
@@ -52,6 +52,8 @@ int main(int argc, char **argv)
     fmt.setAlpha(true);
     fmt.setDepth(true);
     fmt.setDoubleBuffer(true);
+    fmt.setVersion(3, 2);
+    fmt.setProfile(QGLFormat::CoreProfile);
     QGLFormat::setDefaultFormat(fmt);
 
     QApplication app(argc, argv);